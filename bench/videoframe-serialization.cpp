@@ -0,0 +1,175 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This microbenchmark compares the wire format of VideoFrame::serialize() and
+ * VideoFrame::deserialize() with the previous field by field QDataStream
+ * encoding, which is reproduced below. */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <QBuffer>
+#include <QElapsedTimer>
+
+#include "videoframe.hpp"
+
+
+static void legacySerialize(QDataStream& ds, const VideoFrame& f)
+{
+    ds << static_cast<int>(f.inputMode);
+    ds << static_cast<int>(f.surroundMode);
+    ds << f.subtitle;
+    ds << f.width;
+    ds << f.height;
+    ds << f.aspectRatio;
+    ds << static_cast<int>(VideoFrame::Storage_Copied);
+    ds << static_cast<int>(f.pixelFormat);
+    ds << f.yuvValueRangeSmall;
+    ds << static_cast<int>(f.yuvSpace);
+    ds << f.planeCount;
+    for (int p = 0; p < f.planeCount; p++) {
+        ds << f.bytesPerLine[p];
+        ds << f.bytesPerPlane[p];
+        ds.writeRawData(reinterpret_cast<const char*>(f.planeData(p)), f.bytesPerPlane[p]);
+    }
+}
+
+static void legacyDeserialize(QDataStream& ds, VideoFrame& f)
+{
+    int tmp;
+
+    ds >> tmp;
+    f.inputMode = static_cast<InputMode>(tmp);
+    ds >> tmp;
+    f.surroundMode = static_cast<SurroundMode>(tmp);
+    ds >> f.subtitle;
+    ds >> f.width;
+    ds >> f.height;
+    ds >> f.aspectRatio;
+    ds >> tmp;
+    f.storage = static_cast<enum VideoFrame::Storage>(tmp);
+    f.dataIsPrepared = true;
+    f.image = QImage();
+    ds >> tmp;
+    f.pixelFormat = static_cast<QVideoFrameFormat::PixelFormat>(tmp);
+    ds >> f.yuvValueRangeSmall;
+    ds >> tmp;
+    f.yuvSpace = static_cast<enum VideoFrame::YUVSpace>(tmp);
+    ds >> f.planeCount;
+    for (int p = 0; p < 3; p++) {
+        if (p < f.planeCount) {
+            ds >> f.bytesPerLine[p];
+            ds >> f.bytesPerPlane[p];
+            f.bits[p].resize(f.bytesPerPlane[p]);
+            ds.readRawData(reinterpret_cast<char*>(f.bits[p].data()), f.bytesPerPlane[p]);
+        } else {
+            f.bytesPerLine[p] = 0;
+            f.bytesPerPlane[p] = 0;
+            f.bits[p].clear();
+        }
+        f.mappedBits[p] = nullptr;
+    }
+}
+
+static void initFrame(VideoFrame& f, int width, int height)
+{
+    f.inputMode = Input_Left_Right;
+    f.surroundMode = Surround_Off;
+    f.subtitle = QString("Subtitle");
+    f.width = width;
+    f.height = height;
+    f.aspectRatio = float(width) / height;
+    f.storage = VideoFrame::Storage_Copied;
+    f.dataIsPrepared = true;
+    f.pixelFormat = QVideoFrameFormat::Format_YUV420P;
+    f.yuvValueRangeSmall = true;
+    f.yuvSpace = VideoFrame::YUV_BT709;
+    f.planeCount = 3;
+    for (int p = 0; p < 3; p++) {
+        f.bytesPerLine[p] = (p == 0 ? width : width / 2);
+        f.bytesPerPlane[p] = f.bytesPerLine[p] * (p == 0 ? height : height / 2);
+        f.bits[p].resize(f.bytesPerPlane[p]);
+        for (int i = 0; i < f.bytesPerPlane[p]; i++)
+            f.bits[p][i] = i * (p + 1);
+        f.mappedBits[p] = nullptr;
+    }
+}
+
+static bool framesAreEqual(const VideoFrame& f0, const VideoFrame& f1)
+{
+    if (f0.width != f1.width || f0.height != f1.height || f0.planeCount != f1.planeCount
+            || f0.pixelFormat != f1.pixelFormat || f0.subtitle != f1.subtitle)
+        return false;
+    for (int p = 0; p < f0.planeCount; p++)
+        if (f0.bytesPerLine[p] != f1.bytesPerLine[p] || f0.bits[p] != f1.bits[p])
+            return false;
+    return true;
+}
+
+template<typename S, typename D>
+static void bench(const char* name, const VideoFrame& frame, int iterations, S serialize, D deserialize)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadWrite);
+    VideoFrame received;
+    qint64 serializeNsecs = 0;
+    qint64 deserializeNsecs = 0;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; i++) {
+        buffer.seek(0);
+        QDataStream out(&buffer);
+        timer.start();
+        serialize(out, frame);
+        serializeNsecs += timer.nsecsElapsed();
+        buffer.seek(0);
+        QDataStream in(&buffer);
+        timer.start();
+        deserialize(in, received);
+        deserializeNsecs += timer.nsecsElapsed();
+    }
+    if (!framesAreEqual(frame, received)) {
+        std::fprintf(stderr, "%s: received frame differs from sent frame\n", name);
+        std::exit(1);
+    }
+    std::printf("%-8s %10lld bytes  serialize %8.1f us  deserialize %8.1f us\n",
+            name, static_cast<long long>(data.size()),
+            serializeNsecs / 1000.0 / iterations, deserializeNsecs / 1000.0 / iterations);
+}
+
+int main(int argc, char* argv[])
+{
+    int width = (argc > 2 ? std::atoi(argv[1]) : 3840);
+    int height = (argc > 2 ? std::atoi(argv[2]) : 2160);
+    int iterations = (argc > 3 ? std::atoi(argv[3]) : 100);
+    if (width < 2 || height < 2 || iterations < 1) {
+        std::fprintf(stderr, "Usage: %s [width height [iterations]]\n", argv[0]);
+        return 1;
+    }
+
+    VideoFrame frame;
+    initFrame(frame, width, height);
+    std::printf("%dx%d YUV420P frame, %d iterations\n", width, height, iterations);
+    bench("legacy", frame, iterations, legacySerialize, legacyDeserialize);
+    bench("wire", frame, iterations,
+            [](QDataStream& ds, const VideoFrame& f) { f.serialize(ds, true); },
+            [](QDataStream& ds, VideoFrame& f) { f.deserialize(ds, true); });
+    return 0;
+}
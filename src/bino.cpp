@@ -18,20 +18,31 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include <QFont>
 #include <QFontMetrics>
 #include <QTextLayout>
 #include <QPainter>
+#include <QDateTime>
+#include <QMediaDevices>
+#include <QtMath>
 
 #include "bino.hpp"
 #include "log.hpp"
 #include "tools.hpp"
 #include "metadata.hpp"
+#include "uploadthread.hpp"
+#include "framering.hpp"
+#include "framecodec.hpp"
+#include "screenregion.hpp"
 
 
 static Bino* binoSingleton = nullptr;
 
-Bino::Bino(const Screen& screen, bool swapEyes) :
+Bino::Bino(const Screen& screen, bool swapEyes, bool uploadThread,
+        bool vrSharedMemory, FrameCodec::Method vrFrameCompression, bool vrLocalDecoding,
+        bool regionUpload, float fisheyeFieldOfView) :
     _wantExit(false),
     _videoSink(nullptr),
     _audioOutput(nullptr),
@@ -39,18 +50,51 @@ Bino::Bino(const Screen& screen, bool swapEyes) :
     _audioInput(nullptr),
     _videoInput(nullptr),
     _captureSession(nullptr),
+    _mediaGeneration(0),
+    _driftUpdates(0),
+    _driftWithinTolerance(0),
+    _driftResyncs(0),
+    _driftSum(0),
+    _driftMax(0),
     _lastFrameInputMode(Input_Unknown),
     _lastFrameSurroundMode(Surround_Unknown),
     _screen(screen),
+    _frameCubePrg(nullptr),
     _frameIsNew(false),
-    _swapEyes(swapEyes)
+    _framesDropped(0),
+    _framesRepeated(0),
+    _swapEyes(swapEyes),
+    _uploadThread(nullptr),
+    _frameTransport(vrLocalDecoding ? Transport_LocalDecoding
+            : vrSharedMemory ? Transport_SharedMemory
+            : vrFrameCompression != FrameCodec::Method_None ? Transport_Compressed
+            : Transport_Stream),
+    _frameRing(vrSharedMemory ? new FrameRing : nullptr),
+    _frameCodec(vrFrameCompression != FrameCodec::Method_None ? new FrameCodec(vrFrameCompression) : nullptr),
+    _regionUpload(regionUpload && !uploadThread), // the upload thread always uploads full frames
+    _fisheyeFieldOfView(fisheyeFieldOfView)
 {
     Q_ASSERT(!binoSingleton);
     binoSingleton = this;
+    if (uploadThread) {
+        _uploadThread = new UploadThread;
+        // (queued to the GUI thread, where receivers of newVideoFrame() live)
+        connect(_uploadThread, &UploadThread::frameReady, this, [=]() { emit newVideoFrame(); });
+    }
 }
 
 Bino::~Bino()
 {
+    logDrift();
+    if (_videoSink) {
+        LOG_DEBUG("frame queue: %llu frames dropped by video sink, %llu dropped by renderer, %llu repeated",
+                _videoSink->droppedFrames, _framesDropped.load(), _framesRepeated.load());
+    }
+    delete _uploadThread;
+    delete _frameRing;
+    delete _frameCodec;
+    qDeleteAll(_viewPrgs);
+    delete _frameCubePrg;
     delete _videoSink;
     delete _audioOutput;
     delete _player;
@@ -65,9 +109,14 @@ Bino* Bino::instance()
     return binoSingleton;
 }
 
+RenderTargetPool* Bino::renderTargetPool()
+{
+    return &_renderTargetPool;
+}
+
 void Bino::initializeOutput(const QAudioDevice& audioOutputDevice)
 {
-    _videoSink = new VideoSink(&_frame, &_extFrame, &_frameIsNew);
+    _videoSink = new VideoSink(&_frameQueue);
     connect(_videoSink, &VideoSink::newVideoFrame, [=]() { emit newVideoFrame(); });
     _audioOutput = new QAudioOutput;
     _audioOutput->setDevice(audioOutputDevice);
@@ -165,10 +214,52 @@ bool Bino::captureMode() const
     return _captureSession;
 }
 
+void Bino::setPlayerSource(const PlaylistEntry& entry)
+{
+    _player->setSource(entry.url);
+    MetaData metaData;
+    metaData.detectCached(entry.url);
+    if (entry.videoTrack >= 0) {
+        _player->setActiveVideoTrack(entry.videoTrack);
+    }
+    if (entry.audioTrack >= 0) {
+        _player->setActiveAudioTrack(entry.audioTrack);
+    } else if (Playlist::instance()->preferredAudio() != QLocale::AnyLanguage) {
+        int audioTrack = -1;
+        for (int i = 0; i < int(metaData.audioTracks.length()); i++) {
+            QLocale audioLanguage = metaData.audioTracks[i].value(QMediaMetaData::Language).toLocale();
+            if (audioLanguage == Playlist::instance()->preferredAudio()) {
+                audioTrack = i;
+                break;
+            }
+        }
+        if (audioTrack >= 0) {
+            _player->setActiveVideoTrack(entry.audioTrack);
+        }
+    }
+    if (entry.subtitleTrack >= 0) {
+        _player->setActiveSubtitleTrack(entry.subtitleTrack);
+    } else if (entry.subtitleTrack == PlaylistEntry::NoTrack) {
+        // do nothing
+    } else if (metaData.subtitleTracks.size() > 0 && Playlist::instance()->wantSubtitle()) {
+        int subtitleTrack = 0;
+        for (int i = 0; i < int(metaData.subtitleTracks.length()); i++) {
+            QLocale subtitleLanguage = metaData.subtitleTracks[i].value(QMediaMetaData::Language).toLocale();
+            if (subtitleLanguage == Playlist::instance()->preferredSubtitle()) {
+                subtitleTrack = i;
+                break;
+            }
+        }
+        _player->setActiveSubtitleTrack(subtitleTrack);
+    }
+}
+
 void Bino::mediaChanged(PlaylistEntry entry)
 {
     if (!playlistMode())
         return;
+    _mediaEntry = entry;
+    _mediaGeneration++;
     if (entry.noMedia()) {
         _player->stop();
     } else {
@@ -179,42 +270,7 @@ void Bino::mediaChanged(PlaylistEntry entry)
         // the QMediaPlayer before setting the new URL. Not exactly elegant...
         stopPlaylistMode();
         startPlaylistMode();
-        _player->setSource(entry.url);
-        MetaData metaData;
-        metaData.detectCached(entry.url);
-        if (entry.videoTrack >= 0) {
-            _player->setActiveVideoTrack(entry.videoTrack);
-        }
-        if (entry.audioTrack >= 0) {
-            _player->setActiveAudioTrack(entry.audioTrack);
-        } else if (Playlist::instance()->preferredAudio() != QLocale::AnyLanguage) {
-            int audioTrack = -1;
-            for (int i = 0; i < int(metaData.audioTracks.length()); i++) {
-                QLocale audioLanguage = metaData.audioTracks[i].value(QMediaMetaData::Language).toLocale();
-                if (audioLanguage == Playlist::instance()->preferredAudio()) {
-                    audioTrack = i;
-                    break;
-                }
-            }
-            if (audioTrack >= 0) {
-                _player->setActiveVideoTrack(entry.audioTrack);
-            }
-        }
-        if (entry.subtitleTrack >= 0) {
-            _player->setActiveSubtitleTrack(entry.subtitleTrack);
-        } else if (entry.subtitleTrack == PlaylistEntry::NoTrack) {
-            // do nothing
-        } else if (metaData.subtitleTracks.size() > 0 && Playlist::instance()->wantSubtitle()) {
-            int subtitleTrack = 0;
-            for (int i = 0; i < int(metaData.subtitleTracks.length()); i++) {
-                QLocale subtitleLanguage = metaData.subtitleTracks[i].value(QMediaMetaData::Language).toLocale();
-                if (subtitleLanguage == Playlist::instance()->preferredSubtitle()) {
-                    subtitleTrack = i;
-                    break;
-                }
-            }
-            _player->setActiveSubtitleTrack(subtitleTrack);
-        }
+        setPlayerSource(entry);
         _player->play();
         _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
     }
@@ -313,14 +369,18 @@ void Bino::stop()
 void Bino::setSwapEyes(bool s)
 {
     if (_swapEyes != s) {
+        _renderMutex.lock();
         _swapEyes = s;
+        _renderMutex.unlock();
         emit stateChanged();
     }
 }
 
 void Bino::toggleSwapEyes()
 {
+    _renderMutex.lock();
     _swapEyes = !_swapEyes;
+    _renderMutex.unlock();
     emit stateChanged();
 }
 
@@ -353,6 +413,7 @@ void Bino::setSubtitleTrack(int i)
 
 void Bino::setInputMode(InputMode mode)
 {
+    QMutexLocker locker(&_renderMutex);
     _videoSink->inputMode = mode;
     _frame.inputMode = mode;
     _frame.reUpdate();
@@ -362,6 +423,7 @@ void Bino::setInputMode(InputMode mode)
 
 void Bino::setSurroundMode(SurroundMode mode)
 {
+    QMutexLocker locker(&_renderMutex);
     _videoSink->surroundMode = mode;
     _frame.surroundMode = mode;
     _frame.reUpdate();
@@ -467,14 +529,158 @@ void Bino::deserializeStaticData(QDataStream& ds)
     ds >> _screen;
 }
 
+void Bino::serializeFrame(QDataStream& ds, const VideoFrame& frame, int stream) const
+{
+    switch (_frameTransport) {
+    case Transport_Stream:
+    case Transport_LocalDecoding: // frames are not serialized
+        ds << frame;
+        break;
+    case Transport_SharedMemory:
+        _frameRing->serialize(ds, frame);
+        break;
+    case Transport_Compressed:
+        _frameCodec->encode(ds, frame, stream);
+        break;
+    }
+}
+
+void Bino::deserializeFrame(QDataStream& ds, VideoFrame& frame, int stream)
+{
+    switch (_frameTransport) {
+    case Transport_Stream:
+    case Transport_LocalDecoding: // frames are not serialized
+        ds >> frame;
+        break;
+    case Transport_SharedMemory:
+        if (!_frameRing)
+            _frameRing = new FrameRing;
+        _frameRing->deserialize(ds, frame);
+        break;
+    case Transport_Compressed:
+        if (!_frameCodec)
+            _frameCodec = new FrameCodec;
+        _frameCodec->decode(ds, frame, stream);
+        break;
+    }
+}
+
+void Bino::serializePlaybackState(QDataStream& ds) const
+{
+    ds << _mediaGeneration;
+    ds << _mediaEntry.url;
+    ds << static_cast<int>(_mediaEntry.inputMode);
+    ds << static_cast<int>(_mediaEntry.surroundMode);
+    ds << _mediaEntry.videoTrack;
+    ds << _mediaEntry.audioTrack;
+    ds << _mediaEntry.subtitleTrack;
+    ds << static_cast<int>(_videoSink->inputMode);
+    ds << static_cast<int>(_videoSink->surroundMode);
+    bool playing = (_player && _player->playbackState() == QMediaPlayer::PlayingState);
+    ds << playing;
+    ds << static_cast<qint64>(_player ? _player->position() * 1000 : 0);
+    ds << QDateTime::currentMSecsSinceEpoch();
+}
+
+void Bino::deserializePlaybackState(QDataStream& ds)
+{
+    int mediaGeneration;
+    PlaylistEntry entry;
+    int inputMode, surroundMode, tmp;
+    bool playing;
+    qint64 position, masterTime;
+    ds >> mediaGeneration >> entry.url;
+    ds >> tmp;
+    entry.inputMode = static_cast<InputMode>(tmp);
+    ds >> tmp;
+    entry.surroundMode = static_cast<SurroundMode>(tmp);
+    ds >> entry.videoTrack >> entry.audioTrack >> entry.subtitleTrack;
+    ds >> inputMode >> surroundMode;
+    ds >> playing >> position >> masterTime;
+
+    if (!_videoSink) {
+        // Only the main process plays audio
+        initializeOutput(QMediaDevices::defaultAudioOutput());
+        _audioOutput->setMuted(true);
+    }
+    if (mediaGeneration != _mediaGeneration) {
+        _mediaGeneration = mediaGeneration;
+        _mediaEntry = entry;
+        delete _player;
+        _player = nullptr;
+        if (!entry.noMedia()) {
+            LOG_DEBUG("local decoding: opening %s", qPrintable(entry.url.toString()));
+            _player = new QMediaPlayer;
+            _player->setVideoOutput(_videoSink);
+            _player->setAudioOutput(_audioOutput);
+            setPlayerSource(entry);
+            _videoSink->newUrl(entry.url, entry.inputMode, entry.surroundMode);
+        }
+    }
+    if (!_player)
+        return;
+    if (static_cast<InputMode>(inputMode) != _videoSink->inputMode)
+        setInputMode(static_cast<InputMode>(inputMode));
+    if (static_cast<SurroundMode>(surroundMode) != _videoSink->surroundMode)
+        setSurroundMode(static_cast<SurroundMode>(surroundMode));
+
+    // Extrapolate the master position to now. This only helps if the clocks
+    // of the hosts are synchronized, so limit it to plausible transfer times.
+    if (playing)
+        position += std::clamp(QDateTime::currentMSecsSinceEpoch() - masterTime, qint64(0), qint64(100)) * 1000;
+
+    // Follow the play state of the main process and correct the drift of the
+    // local player position
+    bool localPlaying = (_player->playbackState() == QMediaPlayer::PlayingState);
+    if (playing && !localPlaying) {
+        _player->setPosition(position / 1000);
+        _player->play();
+    } else if (!playing && localPlaying) {
+        _player->pause();
+        _player->setPosition(position / 1000);
+    } else if (playing) {
+        qint64 drift = _player->position() * 1000 - position;
+        _driftUpdates++;
+        _driftSum += std::abs(drift);
+        _driftMax = std::max(_driftMax, std::abs(drift));
+        if (std::abs(drift) <= _driftTolerance)
+            _driftWithinTolerance++;
+        if (std::abs(drift) > _driftResyncThreshold) {
+            LOG_DEBUG("local decoding: resynchronizing, drift is %lld ms", drift / 1000);
+            _player->setPosition(position / 1000);
+            _driftResyncs++;
+        }
+        if (_driftUpdates % 1000 == 0)
+            logDrift();
+    }
+
+    // Show the frame that the main process shows
+    selectFrameAt(playing ? position : -1);
+}
+
+void Bino::logDrift() const
+{
+    if (_driftUpdates == 0)
+        return;
+    LOG_DEBUG("local decoding: drift mean %.1f ms, max %.1f ms, %.1f%% within %lld ms, %llu resyncs",
+            _driftSum / 1e3 / _driftUpdates, _driftMax / 1e3,
+            100.0 * _driftWithinTolerance / _driftUpdates, _driftTolerance / 1000,
+            _driftResyncs);
+}
+
 void Bino::serializeDynamicData(QDataStream& ds) const
 {
-    ds << _frameIsNew;
-    if (_frameIsNew) {
-        ds << _frame;
-        if (_frame.inputMode == Input_Alternating_LR
-                || _frame.inputMode == Input_Alternating_RL) {
-            ds << _extFrame;
+    ds << static_cast<int>(_frameTransport);
+    if (_frameTransport == Transport_LocalDecoding) {
+        serializePlaybackState(ds);
+    } else {
+        ds << _frameIsNew;
+        if (_frameIsNew) {
+            serializeFrame(ds, _frame, 0);
+            if (_frame.inputMode == Input_Alternating_LR
+                    || _frame.inputMode == Input_Alternating_RL) {
+                serializeFrame(ds, _extFrame, 1);
+            }
         }
     }
     ds << _swapEyes;
@@ -482,12 +688,19 @@ void Bino::serializeDynamicData(QDataStream& ds) const
 
 void Bino::deserializeDynamicData(QDataStream& ds)
 {
-    ds >> _frameIsNew;
-    if (_frameIsNew) {
-        ds >> _frame;
-        if (_frame.inputMode == Input_Alternating_LR
-                || _frame.inputMode == Input_Alternating_RL) {
-            ds >> _extFrame;
+    int tmp;
+    ds >> tmp;
+    _frameTransport = static_cast<FrameTransport>(tmp);
+    if (_frameTransport == Transport_LocalDecoding) {
+        deserializePlaybackState(ds);
+    } else {
+        ds >> _frameIsNew;
+        if (_frameIsNew) {
+            deserializeFrame(ds, _frame, 0);
+            if (_frame.inputMode == Input_Alternating_LR
+                    || _frame.inputMode == Input_Alternating_RL) {
+                deserializeFrame(ds, _extFrame, 1);
+            }
         }
     }
     ds >> _swapEyes;
@@ -501,59 +714,15 @@ bool Bino::wantExit() const
 bool Bino::initProcess()
 {
     bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
-    bool haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+    _haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+    _haveTexStorage = checkTextureStorageAvailability();
     LOG_DEBUG("Using OpenGL in the %s variant", isGLES ? "ES" : "Desktop");
 
     // Qt-based OpenGL initialization
     initializeOpenGLFunctions();
 
-    // FBO and PBO
-    glGenFramebuffers(1, &_viewFbo);
-    glGenFramebuffers(1, &_frameFbo);
-    glGenTextures(1, &_depthTex);
-    glBindTexture(GL_TEXTURE_2D, _depthTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, 1, 1,
-            0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
-    glBindFramebuffer(GL_FRAMEBUFFER, _viewFbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthTex, 0);
-    CHECK_GL();
-
-    // Quad geometry
-    const float quadPositions[] = {
-        -1.0f, +1.0f, 0.0f,
-        +1.0f, +1.0f, 0.0f,
-        +1.0f, -1.0f, 0.0f,
-        -1.0f, -1.0f, 0.0f
-    };
-    const float quadTexCoords[] = {
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f
-    };
-    static const unsigned short quadIndices[] = {
-        0, 3, 1, 1, 3, 2
-    };
-    glGenVertexArrays(1, &_quadVao);
-    glBindVertexArray(_quadVao);
-    GLuint quadPositionBuf;
-    glGenBuffers(1, &quadPositionBuf);
-    glBindBuffer(GL_ARRAY_BUFFER, quadPositionBuf);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadPositions), quadPositions, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    GLuint quadTexCoordBuf;
-    glGenBuffers(1, &quadTexCoordBuf);
-    glBindBuffer(GL_ARRAY_BUFFER, quadTexCoordBuf);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadTexCoords), quadTexCoords, GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    GLuint quadIndexBuf;
-    glGenBuffers(1, &quadIndexBuf);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuf);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
+    // Render targets
+    _renderTargetPool.initialize();
     CHECK_GL();
 
     // Cube geometry
@@ -637,43 +806,45 @@ bool Bino::initProcess()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
     CHECK_GL();
 
-    // Plane textures
-    glGenTextures(3, _planeTexs);
-    for (int p = 0; p < 3; p++) {
-        glBindTexture(GL_TEXTURE_2D, _planeTexs[p]);
-        unsigned int black = 0;
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 1, 1, 0, GL_RED, GL_UNSIGNED_BYTE, &black);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        if (p == 0) {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        } else {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        }
-    }
+    // Frame upload and color conversion
+    _frameUploader.initialize(&_renderTargetPool);
     CHECK_GL();
 
     // Frame textures
-    glGenTextures(1, &_frameTex);
-    glBindTexture(GL_TEXTURE_2D, _frameTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    if (haveAnisotropicFiltering)
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
-    glGenTextures(1, &_extFrameTex);
-    glBindTexture(GL_TEXTURE_2D, _extFrameTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    if (haveAnisotropicFiltering)
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
+    _frameUploader.createFrameTexture(&_frameTex, &_frameTexStorage);
+    _frameUploader.createFrameTexture(&_extFrameTex, &_extFrameTexStorage);
     CHECK_GL();
 
+    // Cube maps for surround video, see updateFrameCube()
+    for (int i = 0; i < 2; i++) {
+        createFrameCubeTexture(i);
+        _frameCubeTexStorage[i] = { 0, 0, 0, 0, 0 };
+    }
+    if (!isGLES) // always enabled on OpenGL ES 3
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    glGenFramebuffers(1, &_frameCubeFbo);
+    QString cubeVS = readFile(":src/shader-cubemap.vert.glsl");
+    QString cubeFS = readFile(":src/shader-cubemap.frag.glsl");
+    if (isGLES) {
+        cubeVS.prepend("#version 320 es\n");
+        cubeFS.prepend("#version 320 es\n"
+                "precision highp float;\n");
+    } else {
+        cubeVS.prepend("#version 330\n");
+        cubeFS.prepend("#version 330\n");
+    }
+    _frameCubePrg = new QOpenGLShaderProgram;
+    _frameCubePrg->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, cubeVS);
+    _frameCubePrg->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, cubeFS);
+    _frameCubePrg->link();
+    _frameCubePrg->bind();
+    _frameCubePrg->setUniformValue("frameTex", 0);
+    CHECK_GL();
+
+    // Background frame upload
+    if (_uploadThread)
+        _uploadThread->startUploading(QOpenGLContext::currentContext());
+
     // Subtitle texture
     glGenTextures(1, &_subtitleTex);
     glBindTexture(GL_TEXTURE_2D, _subtitleTex);
@@ -681,7 +852,7 @@ bool Bino::initProcess()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    if (haveAnisotropicFiltering)
+    if (_haveAnisotropicFiltering)
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
     CHECK_GL();
 
@@ -713,70 +884,74 @@ bool Bino::initProcess()
     return true;
 }
 
-void Bino::rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall, int yuvSpace)
+Bino::ViewPrg* Bino::viewPrg(SurroundMode surroundMode, bool nonLinearOutput,
+        int fusedPlaneFormat, bool yuvValueRangeSmall, int yuvSpace, bool layered)
 {
-    if (_colorPrg.isLinked()
-            && _colorPrgPlaneFormat == planeFormat
-            && _colorPrgYuvValueRangeSmall == yuvValueRangeSmall
-            && _colorPrgYuvSpace == yuvSpace)
-        return;
-
-    LOG_DEBUG("rebuilding color conversion program for plane format %d, value range %s, yuv space %s",
-            planeFormat, yuvValueRangeSmall ? "small" : "full", yuvSpace ? "true" : "false");
-    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
-    QString colorVS = readFile(":src/shader-color.vert.glsl");
-    QString colorFS = readFile(":src/shader-color.frag.glsl");
-    colorFS.replace("$PLANE_FORMAT", QString::number(planeFormat));
-    colorFS.replace("$VALUE_RANGE_SMALL", yuvValueRangeSmall ? "true" : "false");
-    colorFS.replace("$YUV_SPACE", QString::number(yuvSpace));
-    if (isGLES) {
-        colorVS.prepend("#version 320 es\n");
-        colorFS.prepend("#version 320 es\n"
-                "precision mediump float;\n");
-    } else {
-        colorVS.prepend("#version 330\n");
-        colorFS.prepend("#version 330\n");
+    // the color conversion parameters only matter for fused variants
+    if (fusedPlaneFormat == 0) {
+        yuvValueRangeSmall = false;
+        yuvSpace = 0;
     }
-    _colorPrg.removeAllShaders();
-    _colorPrg.addShaderFromSourceCode(QOpenGLShader::Vertex, colorVS);
-    _colorPrg.addShaderFromSourceCode(QOpenGLShader::Fragment, colorFS);
-    _colorPrg.link();
-    _colorPrgPlaneFormat = planeFormat;
-    _colorPrgYuvValueRangeSmall = yuvValueRangeSmall;
-    _colorPrgYuvSpace = yuvSpace;
-}
-
-void Bino::rebuildViewPrgIfNecessary(SurroundMode surroundMode, bool nonLinearOutput)
-{
-    if (_viewPrg.isLinked()
-            && _viewPrgSurroundMode == surroundMode
-            && _viewPrgNonlinearOutput == nonLinearOutput)
-        return;
-
-    LOG_DEBUG("rebuilding view program for surround mode %s, non linear output %s",
-            surroundModeToString(surroundMode), nonLinearOutput ? "true" : "false");
+    int key = int(surroundMode) | (nonLinearOutput ? (1 << 4) : 0) | (layered ? (1 << 5) : 0) | (fusedPlaneFormat << 8)
+        | (yuvSpace << 16) | (yuvValueRangeSmall ? (1 << 24) : 0);
+    ViewPrg* viewPrg = _viewPrgs.value(key, nullptr);
+    if (viewPrg)
+        return viewPrg;
+
+    LOG_DEBUG("building view program for surround mode %s, non linear output %s, fused plane format %d, layered %s",
+            surroundModeToString(surroundMode), nonLinearOutput ? "true" : "false", fusedPlaneFormat,
+            layered ? "true" : "false");
     bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
     QString viewVS = readFile(":src/shader-view.vert.glsl");
+    QString viewGS = (layered ? readFile(":src/shader-view.geom.glsl") : QString());
     QString viewFS = readFile(":src/shader-view.frag.glsl");
+    viewVS.replace("$VIEW_COUNT", layered ? "2" : "1");
+    viewVS.replace("$LAYERED", layered ? "true" : "false");
+    viewFS.replace("$VIEW_COUNT", layered ? "2" : "1");
     viewFS.replace("$SURROUND_DEGREES",
-              surroundMode == Surround_360 ? "360"
-            : surroundMode == Surround_180 ? "180"
-            : "0");
+              surroundMode == Surround_Off ? "0"
+            : surroundMode == Surround_180 || surroundMode == Surround_180_Fisheye ? "180"
+            : "360");
     viewFS.replace("$NONLINEAR_OUTPUT", nonLinearOutput ? "true" : "false");
+    viewFS.replace("$FUSED_COLOR_CONVERSION", fusedPlaneFormat > 0 ? "true" : "false");
+    // Without fusion, the color conversion code is unused; any plane format will do
+    viewFS.replace("$COLOR_CONVERSION", FrameUploader::colorConversionSource(
+                fusedPlaneFormat > 0 ? fusedPlaneFormat : 1, yuvValueRangeSmall, yuvSpace));
     if (isGLES) {
         viewVS.prepend("#version 320 es\n");
+        viewGS.prepend("#version 320 es\n");
         viewFS.prepend("#version 320 es\n"
                 "precision mediump float;\n");
     } else {
         viewVS.prepend("#version 330\n");
+        viewGS.prepend("#version 330\n");
         viewFS.prepend("#version 330\n");
     }
-    _viewPrg.removeAllShaders();
-    _viewPrg.addShaderFromSourceCode(QOpenGLShader::Vertex, viewVS);
-    _viewPrg.addShaderFromSourceCode(QOpenGLShader::Fragment, viewFS);
-    _viewPrg.link();
-    _viewPrgSurroundMode = surroundMode;
-    _viewPrgNonlinearOutput = nonLinearOutput;
+    viewPrg = new ViewPrg;
+    QOpenGLShaderProgram& prg = viewPrg->prg;
+    prg.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, viewVS);
+    if (layered)
+        prg.addCacheableShaderFromSourceCode(QOpenGLShader::Geometry, viewGS);
+    prg.addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, viewFS);
+    prg.link();
+    viewPrg->projectionModelViewMatrixLoc = prg.uniformLocation("projectionModelViewMatrix");
+    viewPrg->orientationMatrixLoc = prg.uniformLocation("orientationMatrix");
+    viewPrg->viewOffsetXLoc = prg.uniformLocation("view_offset_x");
+    viewPrg->viewFactorXLoc = prg.uniformLocation("view_factor_x");
+    viewPrg->viewOffsetYLoc = prg.uniformLocation("view_offset_y");
+    viewPrg->viewFactorYLoc = prg.uniformLocation("view_factor_y");
+    viewPrg->relativeWidthLoc = prg.uniformLocation("relative_width");
+    viewPrg->relativeHeightLoc = prg.uniformLocation("relative_height");
+    // The sampler uniforms never change, so set them once
+    prg.bind();
+    prg.setUniformValue("frameTex", 0);
+    prg.setUniformValue("subtitleTex", 1);
+    for (int p = 0; p < 3; p++)
+        prg.setUniformValue(qPrintable(QString("plane") + QString::number(p)), 2 + p);
+    prg.setUniformValue("frameCube0", 5);
+    prg.setUniformValue("frameCube1", 6);
+    _viewPrgs.insert(key, viewPrg);
+    return viewPrg;
 }
 
 bool Bino::drawSubtitleToImage(int w, int h, const QString& string)
@@ -840,146 +1015,253 @@ bool Bino::drawSubtitleToImage(int w, int h, const QString& string)
     return true;
 }
 
-void Bino::convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex)
+void Bino::updateFrameTexMipmaps(unsigned int frameTex, TexStorage* frameTexStorage, int maxLevel)
 {
-    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    if (maxLevel < frameTexStorage->validLevels)
+        return;
+    LOG_FIREHOSE("generating frame texture mipmap levels up to %d", maxLevel);
+    glBindTexture(GL_TEXTURE_2D, frameTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    frameTexStorage->validLevels = maxLevel + 1;
+}
 
-    // 1. Get the frame data into plane textures
-    int w = frame.width;
-    int h = frame.height;
-    int planeFormat; // see shader-color.frag.glsl
-    int planeCount;
-    // reset swizzling for plane0; might be changed below depending in the format
-    glBindTexture(GL_TEXTURE_2D, _planeTexs[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_BLUE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
-    if (frame.storage == VideoFrame::Storage_Image) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame.image.constBits());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
-        planeFormat = 1;
-        planeCount = 1;
-    } else {
-        std::array<const void*, 3> planeData;
-        if (frame.storage == VideoFrame::Storage_Mapped) {
-            planeData = { frame.mappedBits[0], frame.mappedBits[1], frame.mappedBits[2] };
+void Bino::createFrameCubeTexture(int slot)
+{
+    glGenTextures(1, &(_frameCubeTex[slot]));
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _frameCubeTex[slot]);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    if (_haveAnisotropicFiltering)
+        glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
+}
+
+void Bino::updateFrameCube(int slot, unsigned int frameTex, int frameViewWidth,
+        float viewOffsetX, float viewFactorX, float viewOffsetY, float viewFactorY)
+{
+    TexStorage* storage = &(_frameCubeTexStorage[slot]);
+    if (storage->validLevels > 0)
+        return;
+
+    // Each cube face covers 90 degrees, so the face size that keeps the
+    // resolution of the frame at the equator is a quarter of the frame width
+    // for 360 degree video and half of it for 180 degree video. Cube map
+    // layouts have three faces side by side, and a fisheye image spans the
+    // lens field of view.
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    int degrees = (_frame.surroundMode == Surround_180 || _frame.surroundMode == Surround_180_Fisheye ? 180 : 360);
+    int projection = (_frame.surroundMode == Surround_360_Cubemap ? 1
+            : _frame.surroundMode == Surround_360_EAC ? 2
+            : _frame.surroundMode == Surround_180_Fisheye ? 3 : 0);
+    GLint maxSize;
+    glGetIntegerv(GL_MAX_CUBE_MAP_TEXTURE_SIZE, &maxSize);
+    int size = std::clamp(
+              projection == 0 ? frameViewWidth * 90 / degrees
+            : projection == 3 ? int(frameViewWidth * 90 / _fisheyeFieldOfView)
+            : frameViewWidth / 3, 1, int(maxSize));
+    unsigned int internalFormat = (isGLES ? GL_RGB10_A2 : GL_RGBA16);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _frameCubeTex[slot]);
+    if (storage->internalFormat != internalFormat || storage->width != size) {
+        // Allocate the storage only when the face size changes, like
+        // FrameUploader::updateTexStorage() does for 2D textures
+        LOG_DEBUG("reallocating cube map %d storage: %dx%d", slot, size, size);
+        int levels = 1;
+        for (int s = size; s > 1; s /= 2)
+            levels++;
+        if (_haveTexStorage) {
+            // Immutable storage cannot be respecified, so we need a new texture object
+            glDeleteTextures(1, &(_frameCubeTex[slot]));
+            createFrameCubeTexture(slot);
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, internalFormat, size, size);
         } else {
-            planeData = { frame.bits[0].data(), frame.bits[1].data(), frame.bits[2].data() };
+            // Mutable storage: allocate the base level; glGenerateMipmap()
+            // takes care of the other levels
+            for (int f = 0; f < 6; f++) {
+                if (isGLES)
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, internalFormat, size, size, 0,
+                            GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullptr);
+                else
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, internalFormat, size, size, 0,
+                            GL_RGBA, GL_UNSIGNED_SHORT, nullptr);
+            }
         }
-        if (frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888
-                || frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888_Premultiplied
-                || frame.pixelFormat == QVideoFrameFormat::Format_XRGB8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ALPHA);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_GREEN);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_BLUE);
-            planeFormat = 1;
-            planeCount = 1;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888
-                || frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888_Premultiplied
-                || frame.pixelFormat == QVideoFrameFormat::Format_BGRX8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ALPHA);
-            planeFormat = 1;
-            planeCount = 1;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_ABGR8888
-                || frame.pixelFormat == QVideoFrameFormat::Format_XBGR8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ALPHA);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_BLUE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_GREEN);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
-            planeFormat = 1;
-            planeCount = 1;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_RGBA8888
-                || frame.pixelFormat == QVideoFrameFormat::Format_RGBX8888) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, planeData[0]);
-            planeFormat = 1;
-            planeCount = 1;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV420P) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w / 2, h / 2, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[1]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[2]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w / 2, h / 2, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[2]);
-            planeFormat = 2;
-            planeCount = 3;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV422P) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w / 2, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[1]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[2]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w / 2, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[2]);
-            planeFormat = 2;
-            planeCount = 3;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YV12) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w / 2, h / 2, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[1]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[2]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w / 2, h / 2, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[2]);
-            planeFormat = 3;
-            planeCount = 3;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_NV12) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, w / 2, h / 2, 0, GL_RG, GL_UNSIGNED_BYTE, planeData[1]);
-            planeFormat = 4;
-            planeCount = 2;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_P010
-                || frame.pixelFormat == QVideoFrameFormat::Format_P016) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, w, h, 0, GL_RED, GL_UNSIGNED_SHORT, planeData[0]);
-            glBindTexture(GL_TEXTURE_2D, _planeTexs[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, w / 2, h / 2, 0, GL_RG, GL_UNSIGNED_SHORT, planeData[1]);
-            planeFormat = 4;
-            planeCount = 2;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y8) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, planeData[0]);
-            planeFormat = 5;
-            planeCount = 1;
-        } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y16) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, w, h, 0, GL_RED, GL_UNSIGNED_SHORT, planeData[0]);
-            planeFormat = 5;
-            planeCount = 1;
+        storage->internalFormat = internalFormat;
+        storage->width = size;
+        storage->height = size;
+        storage->levels = levels;
+    }
+    LOG_FIREHOSE("projecting frame into %dx%d cube map %d", size, size, slot);
+
+    // Resample the frame into the six faces
+    glBindFramebuffer(GL_FRAMEBUFFER, _frameCubeFbo);
+    glViewport(0, 0, size, size);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(_frameCubePrg->programId());
+    _frameCubePrg->setUniformValue("face_size", float(size));
+    _frameCubePrg->setUniformValue("surround_degrees", degrees);
+    _frameCubePrg->setUniformValue("projection", projection);
+    _frameCubePrg->setUniformValue("fisheye_fov", qDegreesToRadians(_fisheyeFieldOfView));
+    _frameCubePrg->setUniformValue("view_offset_x", viewOffsetX);
+    _frameCubePrg->setUniformValue("view_factor_x", viewFactorX);
+    _frameCubePrg->setUniformValue("view_offset_y", viewOffsetY);
+    _frameCubePrg->setUniformValue("view_factor_y", viewFactorY);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, frameTex);
+    // Set up filtering to work correctly at the horizontal wraparound:
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if (degrees == 360)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindVertexArray(_cubeVao); // any vertex array will do; the shader has no attributes
+    for (int f = 0; f < 6; f++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, _frameCubeTex[slot], 0);
+        _frameCubePrg->setUniformValue("face", f);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, 0);
+    // Reset filtering parameters to their defaults
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    // The mipmap levels filter the oversampled regions near the poles. They
+    // are only regenerated here, when the cube map contents changed: the
+    // validLevels check above skips cube maps of frames that are not new.
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _frameCubeTex[slot]);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    storage->validLevels = storage->levels;
+}
+
+int Bino::frameTexMaxLevel(const QMatrix4x4& projectionModelViewMatrix,
+        int texWidth, int texHeight, int frameViewWidth, int frameViewHeight,
+        float relWidth, float relHeight, int levels) const
+{
+    // Project the screen into the target texture to find out how many
+    // frame texels end up on one pixel
+    float minX = +1.0f, maxX = -1.0f, minY = +1.0f, maxY = -1.0f;
+    for (int i = 0; i + 2 < _screen.positions.size(); i += 3) {
+        QVector4D p = projectionModelViewMatrix * QVector4D(
+                _screen.positions[i], _screen.positions[i + 1], _screen.positions[i + 2], 1.0f);
+        if (p.w() <= 0.0f) // screen reaches behind the viewer
+            return levels - 1;
+        minX = std::min(minX, p.x() / p.w());
+        maxX = std::max(maxX, p.x() / p.w());
+        minY = std::min(minY, p.y() / p.w());
+        maxY = std::max(maxY, p.y() / p.w());
+    }
+    float screenWidth = 0.5f * (maxX - minX) * texWidth * relWidth;
+    float screenHeight = 0.5f * (maxY - minY) * texHeight * relHeight;
+    if (screenWidth < 1.0f || screenHeight < 1.0f)
+        return levels - 1;
+    float ratio = std::max(frameViewWidth / screenWidth, frameViewHeight / screenHeight);
+    // In VR mode, the bounding box only gives an average; parts of a screen
+    // that is seen at an angle are minified more strongly.
+    if (_screen.aspectRatio > 0.0f)
+        ratio *= 2.0f;
+    return mipmapMaxLevel(ratio, levels);
+}
+
+QMutex* Bino::renderMutex()
+{
+    return &_renderMutex;
+}
+
+qint64 Bino::frameSelectionTime(qint64 presentationDelay) const
+{
+    bool playing = (_player && _player->playbackState() == QMediaPlayer::PlayingState);
+    return (playing ? _player->position() * 1000 + presentationDelay : -1);
+}
+
+bool Bino::selectFrame(qint64 presentationDelay)
+{
+    return selectFrameAt(frameSelectionTime(presentationDelay));
+}
+
+bool Bino::selectFrameAt(qint64 target)
+{
+    if (_uploadThread) {
+        // The upload thread takes the frame and reports via frameReady()
+        _uploadThread->requestFrame(target);
+        return false;
+    }
+    bool framesPending;
+    if (takeFrameFromQueue(target, &_frame, &_extFrame, &framesPending))
+        _frameIsNew = true;
+    return framesPending;
+}
+
+bool Bino::takeFrameFromQueue(qint64 target, VideoFrame* frame, VideoFrame* extFrame, bool* framesPending)
+{
+    _frameQueue.beginConsume();
+    int queued = _frameQueue.size();
+    bool playing = (target >= 0);
+
+    // Find the newest queued frame that is due when the rendered image
+    // becomes visible. Without timing information (paused, capture mode,
+    // unknown timestamps) the newest frame is always due.
+    int chosen = -1;
+    for (int i = 0; i < queued; i++) {
+        const FrameQueue::Entry* entry = _frameQueue.consumerEntry(i);
+        qint64 halfDuration = (entry->duration > 0 ? entry->duration / 2 : 0);
+        if (target < 0 || entry->presentationTime < 0
+                || entry->presentationTime - halfDuration <= target) {
+            chosen = i;
+        } else if (entry->presentationTime - target > 1000000) {
+            // far ahead of the player position: a discontinuity such as a seek,
+            // so show it instead of waiting for it
+            chosen = i;
         } else {
-            LOG_FATAL("Unhandled pixel format");
-            std::exit(1);
+            break;
         }
     }
-    // 2. Convert plane textures into linear RGB in the frame texture
-    glBindTexture(GL_TEXTURE_2D, frameTex);
-    if (isGLES)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, w, h, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullptr);
-    else
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, w, h, 0, GL_BGRA, GL_UNSIGNED_SHORT, nullptr);
-    glBindFramebuffer(GL_FRAMEBUFFER, _frameFbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameTex, 0);
-    glViewport(0, 0, w, h);
-    glDisable(GL_DEPTH_TEST);
-    rebuildColorPrgIfNecessary(planeFormat, frame.yuvValueRangeSmall, frame.yuvSpace);
-    glUseProgram(_colorPrg.programId());
-    for (int p = 0; p < planeCount; p++) {
-        _colorPrg.setUniformValue(qPrintable(QString("plane") + QString::number(p)), p);
-        glActiveTexture(GL_TEXTURE0 + p);
-        glBindTexture(GL_TEXTURE_2D, _planeTexs[p]);
+
+    if (chosen < 0) {
+        if (playing && queued == 0)
+            _framesRepeated++;
+        *framesPending = (queued > 0);
+        _frameQueue.endConsume();
+        return false;
     }
-    glBindVertexArray(_quadVao);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
-    glBindTexture(GL_TEXTURE_2D, frameTex);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // Drop the frames that were overtaken by the chosen one
+    for (int i = 0; i < chosen; i++) {
+        LOG_FIREHOSE("frame queue: dropping frame %lld", _frameQueue.consumerEntry(0)->presentationTime);
+        _frameQueue.pop();
+        _framesDropped++;
+    }
+    // Swap instead of copy: the video sink recycles the previous frame
+    FrameQueue::Entry* entry = _frameQueue.consumerEntry(0);
+    LOG_FIREHOSE("frame queue: selecting frame %lld for target %lld", entry->presentationTime, target);
+    std::swap(*frame, entry->frame);
+    std::swap(*extFrame, entry->extFrame);
+    _frameQueue.pop();
+    _frameQueue.endConsume();
+    // Only now map or convert the frame data, now that it will be displayed
+    frame->prepareData();
+    extFrame->prepareData();
+    *framesPending = (_frameQueue.size() > 0);
+    return true;
 }
 
-void Bino::preRenderProcess(int screenWidth, int screenHeight,
+void Bino::preRenderProcess(int screenWidth, int screenHeight, int subtitleTrack,
         int* viewCountPtr, int* viewWidthPtr, int* viewHeightPtr, float* frameDisplayAspectRatioPtr, bool* surroundPtr)
 {
+    if (_uploadThread && _uploadThread->frameAvailable()) {
+        // Take over the frame textures that the upload thread prepared, and
+        // hand it our current ones once we are done sampling them.
+        GLsync releaseFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        GLsync readyFence = _uploadThread->takeFrame(&_frame, &_extFrame,
+                &_frameTex, &_frameTexStorage, &_extFrameTex, &_extFrameTexStorage,
+                releaseFence);
+        glWaitSync(readyFence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(readyFence);
+        _frameIsNew = true;
+    }
+
     Q_ASSERT(_frame.inputMode != Input_Unknown);
 
     int viewCount = 2;
@@ -1016,12 +1298,17 @@ void Bino::preRenderProcess(int screenWidth, int screenHeight,
     case Surround_Off:
         break;
     case Surround_180:
+    case Surround_180_Fisheye:
         frameDisplayAspectRatio *= 2.0f;
         break;
     case Surround_360:
         break;
+    case Surround_360_EAC:
+    case Surround_360_Cubemap:
+        frameDisplayAspectRatio *= 4.0f / 3.0f;
+        break;
     }
-    if (subtitleTrack() >= 0 && (screenWidth > viewWidth || screenHeight > viewHeight)) {
+    if (subtitleTrack >= 0 && (screenWidth > viewWidth || screenHeight > viewHeight)) {
         if (screenWidth / viewWidth > screenHeight / viewHeight) {
             viewWidth = screenWidth;
             viewHeight = viewWidth / frameDisplayAspectRatio;
@@ -1045,18 +1332,58 @@ void Bino::preRenderProcess(int screenWidth, int screenHeight,
     /* We need to get new frame data into a texture that is suitable for
      * rendering the screen: _frameTex. */
 
+    if (_regionUpload) {
+        // Upload only the tiles of the frame that the views of this process
+        // sampled in the previous frame, including a margin for head movement.
+        // The other tiles get a low resolution version of the frame.
+        // If no views were rendered since the last upload, e.g. because the
+        // widget only reprojected its surround views, keep the previous tiles.
+        // If the views now need more than was uploaded, upload again.
+        FrameTiles neededTiles = (!_neededTiles.isEmpty() ? _neededTiles
+                : !_uploadedTiles.isEmpty() ? _uploadedTiles : FrameTiles::all());
+        _neededTiles = FrameTiles();
+        if (!_frameIsNew && !_uploadedTiles.contains(neededTiles)) {
+            LOG_FIREHOSE("uploaded tiles do not cover the views anymore, uploading again");
+            _frameIsNew = true;
+        }
+        if (_frameIsNew) {
+            LOG_FIREHOSE("uploading %d of %d frame tiles", neededTiles.count(), FrameTiles::columns * FrameTiles::rows);
+            _uploadedTiles = neededTiles;
+            _frameUploader.setTiles(_uploadedTiles);
+        }
+    }
+
     if (_frameIsNew) {
-        // Convert _frame into _frameTex and, if needed, _extFrame into _extFrameTex.
-        convertFrameToTexture(_frame, _frameTex);
-        if (_frame.inputMode == Input_Alternating_LR
+        if (_uploadThread) {
+            // The upload thread already converted the frames into the frame textures
+        } else if (_frame.inputMode == Input_Alternating_LR
                 || _frame.inputMode == Input_Alternating_RL) {
+            // Convert _frame into _frameTex and _extFrame into _extFrameTex.
+            _frameUploader.convertFrameToTexture(_frame, &_frameTex, &_frameTexStorage);
             // the user might have switched to this mode without the extFrame
             // being available, in that case fall back to the standard frame
             if (_extFrame.width != _frame.width || _extFrame.height != _frame.height)
-                convertFrameToTexture(_frame, _extFrameTex);
+                _frameUploader.convertFrameToTexture(_frame, &_extFrameTex, &_extFrameTexStorage);
             else
-                convertFrameToTexture(_extFrame, _extFrameTex);
+                _frameUploader.convertFrameToTexture(_extFrame, &_extFrameTex, &_extFrameTexStorage);
+        } else {
+            // Only upload the planes of _frame. render() either converts them
+            // into _frameTex when it needs that texture, or it converts them
+            // on the fly while rendering the view.
+            _frameUploader.uploadFrame(_frame);
+            _frameTexStorage.validLevels = 0;
         }
+        // Frames from shared memory were read directly from a slot that the
+        // main process may have reused in the meantime
+        if (_frameRing && !_uploadThread
+                && (!_frameRing->dataIsIntact(_frame)
+                    || ((_frame.inputMode == Input_Alternating_LR || _frame.inputMode == Input_Alternating_RL)
+                        && !_frameRing->dataIsIntact(_extFrame)))) {
+            LOG_WARNING("frame data in shared memory was overwritten during the upload");
+        }
+        // The surround cube maps are projected from the new frame on demand
+        _frameCubeTexStorage[0].validLevels = 0;
+        _frameCubeTexStorage[1].validLevels = 0;
         // Render the subtitle into the subtitle texture
         if (drawSubtitleToImage(viewWidth, viewHeight, _frame.subtitle)) {
             glBindTexture(GL_TEXTURE_2D, _subtitleTex);
@@ -1070,7 +1397,9 @@ void Bino::preRenderProcess(int screenWidth, int screenHeight,
     }
     if (_frame.inputMode != _lastFrameInputMode
             || _frame.surroundMode != _lastFrameSurroundMode) {
-        emit stateChanged();
+        // This may run on the render thread; the GUI reacts to the signal
+        // on the GUI thread
+        QMetaObject::invokeMethod(this, [=]() { emit stateChanged(); });
     }
     _lastFrameInputMode = _frame.inputMode;
     _lastFrameSurroundMode = _frame.surroundMode;
@@ -1081,83 +1410,153 @@ void Bino::render(
         const QMatrix4x4& orientationMatrix,
         const QMatrix4x4& viewMatrix,
         int view, // 0 = left, 1 = right
+        int texWidth, int texHeight, unsigned int texture, int textureLayer)
+{
+    renderViews(1, &view, &projectionMatrix, &orientationMatrix, &viewMatrix,
+            texWidth, texHeight, texture, textureLayer);
+}
+
+bool Bino::renderStereo(
+        const QMatrix4x4* projectionMatrices,
+        const QMatrix4x4* orientationMatrices,
+        const QMatrix4x4* viewMatrices,
         int texWidth, int texHeight, unsigned int texture)
 {
-    // Set up framebuffer object to render into
-    glBindTexture(GL_TEXTURE_2D, _depthTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, texWidth, texHeight,
-            0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
-    glEnable(GL_DEPTH_TEST);
-    glBindFramebuffer(GL_FRAMEBUFFER, _viewFbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-    // Set up view
-    glViewport(0, 0, texWidth, texHeight);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    // Set up input mode
+    // Alternating input has a separate frame texture per view. The final
+    // rendering step in VR mode may draw arbitrary screen geometry, which
+    // needs the depth test, and layered framebuffers have no depth buffer.
+    if (_frame.inputMode == Input_Alternating_LR || _frame.inputMode == Input_Alternating_RL
+            || _screen.aspectRatio > 0.0f)
+        return false;
+    const int views[2] = { 0, 1 };
+    renderViews(2, views, projectionMatrices, orientationMatrices, viewMatrices,
+            texWidth, texHeight, texture, RenderTargetPool::AllLayers);
+    return true;
+}
+
+void Bino::renderViews(int viewCount, const int* views,
+        const QMatrix4x4* projectionMatrices,
+        const QMatrix4x4* orientationMatrices,
+        const QMatrix4x4* viewMatrices,
+        int texWidth, int texHeight, unsigned int texture, int textureLayer)
+{
+    Q_ASSERT(viewCount == 1 || (viewCount == 2 && textureLayer == RenderTargetPool::AllLayers));
+
+    // Set up input mode for each view
     unsigned int frameTex = _frameTex;
     float frameAspectRatio = _frame.aspectRatio;
-    float viewOffsetX = 0.0f;
-    float viewFactorX = 1.0f;
-    float viewOffsetY = 0.0f;
-    float viewFactorY = 1.0f;
-    if (_swapEyes)
-        view = (view == 0 ? 1 : 0);
-    switch (_frame.inputMode) {
-    case Input_Unknown: // cannot happen, update() sets a known mode
-    case Input_Mono:
-        // nothing to do
-        break;
-    case Input_Top_Bottom:
-        viewFactorY = 0.5f;
-        viewOffsetY = (view == 1 ? 0.5f : 0.0f);
-        frameAspectRatio *= 2.0f;
-        break;
-    case Input_Top_Bottom_Half:
-        viewFactorY = 0.5f;
-        viewOffsetY = (view == 1 ? 0.5f : 0.0f);
-        break;
-    case Input_Bottom_Top:
-        viewFactorY = 0.5f;
-        viewOffsetY = (view != 1 ? 0.5f : 0.0f);
-        frameAspectRatio *= 2.0f;
-        break;
-    case Input_Bottom_Top_Half:
-        viewFactorY = 0.5f;
-        viewOffsetY = (view != 1 ? 0.5f : 0.0f);
-        break;
-    case Input_Left_Right:
-        viewFactorX = 0.5f;
-        viewOffsetX = (view == 1 ? 0.5f : 0.0f);
-        frameAspectRatio /= 2.0f;
-        break;
-    case Input_Left_Right_Half:
-        viewFactorX = 0.5f;
-        viewOffsetX = (view == 1 ? 0.5f : 0.0f);
-        break;
-    case Input_Right_Left:
-        viewFactorX = 0.5f;
-        viewOffsetX = (view != 1 ? 0.5f : 0.0f);
-        frameAspectRatio /= 2.0f;
-        break;
-    case Input_Right_Left_Half:
-        viewFactorX = 0.5f;
-        viewOffsetX = (view != 1 ? 0.5f : 0.0f);
-        break;
-    case Input_Alternating_LR:
-        if (view == 1)
-            frameTex = _extFrameTex;
-        break;
-    case Input_Alternating_RL:
-        if (view == 0)
-            frameTex = _extFrameTex;
-        break;
+    float viewOffsetX[2], viewFactorX[2], viewOffsetY[2], viewFactorY[2];
+    int sourceView[2]; // the view in the frame that is sampled, after swapping eyes
+    for (int i = 0; i < viewCount; i++) {
+        int view = views[i];
+        frameAspectRatio = _frame.aspectRatio;
+        viewOffsetX[i] = 0.0f;
+        viewFactorX[i] = 1.0f;
+        viewOffsetY[i] = 0.0f;
+        viewFactorY[i] = 1.0f;
+        if (_swapEyes)
+            view = (view == 0 ? 1 : 0);
+        sourceView[i] = view;
+        switch (_frame.inputMode) {
+        case Input_Unknown: // cannot happen, update() sets a known mode
+        case Input_Mono:
+            // nothing to do
+            break;
+        case Input_Top_Bottom:
+            viewFactorY[i] = 0.5f;
+            viewOffsetY[i] = (view == 1 ? 0.5f : 0.0f);
+            frameAspectRatio *= 2.0f;
+            break;
+        case Input_Top_Bottom_Half:
+            viewFactorY[i] = 0.5f;
+            viewOffsetY[i] = (view == 1 ? 0.5f : 0.0f);
+            break;
+        case Input_Bottom_Top:
+            viewFactorY[i] = 0.5f;
+            viewOffsetY[i] = (view != 1 ? 0.5f : 0.0f);
+            frameAspectRatio *= 2.0f;
+            break;
+        case Input_Bottom_Top_Half:
+            viewFactorY[i] = 0.5f;
+            viewOffsetY[i] = (view != 1 ? 0.5f : 0.0f);
+            break;
+        case Input_Left_Right:
+            viewFactorX[i] = 0.5f;
+            viewOffsetX[i] = (view == 1 ? 0.5f : 0.0f);
+            frameAspectRatio /= 2.0f;
+            break;
+        case Input_Left_Right_Half:
+            viewFactorX[i] = 0.5f;
+            viewOffsetX[i] = (view == 1 ? 0.5f : 0.0f);
+            break;
+        case Input_Right_Left:
+            viewFactorX[i] = 0.5f;
+            viewOffsetX[i] = (view != 1 ? 0.5f : 0.0f);
+            frameAspectRatio /= 2.0f;
+            break;
+        case Input_Right_Left_Half:
+            viewFactorX[i] = 0.5f;
+            viewOffsetX[i] = (view != 1 ? 0.5f : 0.0f);
+            break;
+        case Input_Alternating_LR:
+            if (view == 1)
+                frameTex = _extFrameTex;
+            break;
+        case Input_Alternating_RL:
+            if (view == 0)
+                frameTex = _extFrameTex;
+            break;
+        }
     }
-    LOG_FIREHOSE("Rendering view %d from %s frame texture fx=%g ox=%g fy=%g oy=%g",
-            view, frameTex == _frameTex ? "standard" : "extended", viewFactorX, viewOffsetX, viewFactorY, viewOffsetY);
     // Determine if we are producing the final rendering result here (which is the
     // case for VR mode) or if we are just rendering to intermediate textures (which
     // is the case for GUI mode). In GUI mode, the screen aspect ratio is unknown.
     bool finalRenderingStep = (_screen.aspectRatio > 0.0f);
+    // Flat frames that are drawn 1:1 into an intermediate texture can be
+    // color converted directly from the planes while rendering the view, which
+    // saves the round trip through the frame texture.
+    // (All views share the same view size in the frame.)
+    bool fusedColorConversion = (!finalRenderingStep
+            && _frame.surroundMode == Surround_Off
+            && frameTex == _frameTex
+            && _frameTexStorage.validLevels == 0
+            && _frameUploader.tiles().isFull()
+            && texWidth == int(_frame.width * viewFactorX[0])
+            && texHeight == int(_frame.height * viewFactorY[0]));
+    if (frameTex == _frameTex && _frameTexStorage.validLevels == 0 && !fusedColorConversion)
+        _frameUploader.convertPlanesToTexture(_frame, &_frameTex, &_frameTexStorage);
+    for (int i = 0; i < viewCount; i++) {
+        LOG_FIREHOSE("Rendering view %d from %s fx=%g ox=%g fy=%g oy=%g", views[i],
+                fusedColorConversion ? "planes" : frameTex == _frameTex ? "standard frame texture" : "extended frame texture",
+                viewFactorX[i], viewOffsetX[i], viewFactorY[i], viewOffsetY[i]);
+    }
+    // Project surround frames into a cube map once per frame and eye; all
+    // views of that eye then share it. Mono frames need only one cube map.
+    // The cube maps belong to the views in the frame, so that swapping the
+    // eyes does not require a new projection.
+    int frameCubeSlot[2] = { 0, 0 };
+    if (_frame.surroundMode != Surround_Off) {
+        for (int i = 0; i < viewCount; i++) {
+            if (frameTex != _frameTex || viewFactorX[i] < 1.0f || viewFactorY[i] < 1.0f)
+                frameCubeSlot[i] = sourceView[i];
+            updateFrameCube(frameCubeSlot[i], frameTex, _frame.width * viewFactorX[i],
+                    viewOffsetX[i], viewFactorX[i], viewOffsetY[i], viewFactorY[i]);
+        }
+    }
+    // Set up framebuffer object to render into. Layered rendering has no
+    // depth buffer; it is only used for the flat screen or the surround cube,
+    // which do not need the depth test.
+    bool layered = (textureLayer == RenderTargetPool::AllLayers);
+    if (layered)
+        glDisable(GL_DEPTH_TEST);
+    else
+        glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, textureLayer == RenderTargetPool::NoLayer
+            ? _renderTargetPool.framebuffer(texture, texWidth, texHeight, true)
+            : _renderTargetPool.framebuffer(texture, textureLayer, texWidth, texHeight, !layered));
+    // Set up view
+    glViewport(0, 0, texWidth, texHeight);
+    glClear(layered ? GL_COLOR_BUFFER_BIT : (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
     // Set up correct aspect ratio on screen
     float relWidth = 1.0f;
     float relHeight = 1.0f;
@@ -1167,40 +1566,97 @@ void Bino::render(
         else
             relWidth = frameAspectRatio / _screen.aspectRatio;
     }
+    // Remember which tiles of the frame each view samples, for the next upload
+    for (int i = 0; _regionUpload && i < viewCount; i++) {
+        // (visibleSurroundRegion() only knows the equirectangular projection;
+        // cube map layouts and fisheye images always need the full frame)
+        QRectF region = (_frame.surroundMode == Surround_Off
+                ? visibleScreenRegion(_screen, projectionMatrices[i] * viewMatrices[i])
+                : _frame.surroundMode == Surround_360 || _frame.surroundMode == Surround_180
+                ? visibleSurroundRegion(projectionMatrices[i], orientationMatrices[i],
+                    _frame.surroundMode == Surround_360 ? 360 : 180)
+                : QRectF(0.0f, 0.0f, 1.0f, 1.0f));
+        // Add a margin for head movement, and split regions that wrap around
+        QList<QRectF> regions;
+        if (!region.isEmpty()) {
+            region.adjust(-0.05f, -0.05f, +0.05f, +0.05f);
+            const QRectF fullRegion(0.0f, 0.0f, 1.0f, 1.0f);
+            regions.append(region.intersected(fullRegion));
+            if (_frame.surroundMode == Surround_360) {
+                regions.append(region.translated(-1.0f, 0.0f).intersected(fullRegion));
+                regions.append(region.translated(+1.0f, 0.0f).intersected(fullRegion));
+            }
+        }
+        for (const QRectF& part : regions) {
+            if (part.isEmpty())
+                continue;
+            // Apply the same mapping as the view shader
+            float tx0, tx1, ty0, ty1;
+            if (_frame.surroundMode == Surround_Off) {
+                tx0 = (viewOffsetX[i] + viewFactorX[i] * part.left() - 0.5f * (1.0f - relWidth)) / relWidth;
+                tx1 = (viewOffsetX[i] + viewFactorX[i] * part.right() - 0.5f * (1.0f - relWidth)) / relWidth;
+                ty0 = (1.0f - viewOffsetY[i] - viewFactorY[i] * part.bottom() - 0.5f * (1.0f - relHeight)) / relHeight;
+                ty1 = (1.0f - viewOffsetY[i] - viewFactorY[i] * part.top() - 0.5f * (1.0f - relHeight)) / relHeight;
+            } else {
+                tx0 = viewOffsetX[i] + viewFactorX[i] * part.left();
+                tx1 = viewOffsetX[i] + viewFactorX[i] * part.right();
+                ty0 = viewOffsetY[i] + viewFactorY[i] * part.top();
+                ty1 = viewOffsetY[i] + viewFactorY[i] * part.bottom();
+            }
+            _neededTiles.add(QRectF(tx0, ty0, tx1 - tx0, ty1 - ty0));
+        }
+    }
     // Set up shader program
-    rebuildViewPrgIfNecessary(_frame.surroundMode, finalRenderingStep);
-    glUseProgram(_viewPrg.programId());
-    QMatrix4x4 projectionModelViewMatrix = projectionMatrix;
-    if (_frame.surroundMode == Surround_Off)
-        projectionModelViewMatrix = projectionModelViewMatrix * viewMatrix;
-    _viewPrg.setUniformValue("projectionModelViewMatrix", projectionModelViewMatrix);
-    _viewPrg.setUniformValue("orientationMatrix", orientationMatrix);
-    _viewPrg.setUniformValue("frameTex", 0);
-    _viewPrg.setUniformValue("subtitleTex", 1);
-    _viewPrg.setUniformValue("view_offset_x", viewOffsetX);
-    _viewPrg.setUniformValue("view_factor_x", viewFactorX);
-    _viewPrg.setUniformValue("view_offset_y", viewOffsetY);
-    _viewPrg.setUniformValue("view_factor_y", viewFactorY);
-    _viewPrg.setUniformValue("relative_width", relWidth);
-    _viewPrg.setUniformValue("relative_height", relHeight);
+    ViewPrg* prg = viewPrg(_frame.surroundMode, finalRenderingStep,
+            fusedColorConversion ? _frameUploader.planeFormat() : 0, _frame.yuvValueRangeSmall, _frame.yuvSpace,
+            layered);
+    glUseProgram(prg->prg.programId());
+    QMatrix4x4 projectionModelViewMatrix[2];
+    for (int i = 0; i < viewCount; i++) {
+        projectionModelViewMatrix[i] = projectionMatrices[i];
+        if (_frame.surroundMode == Surround_Off)
+            projectionModelViewMatrix[i] = projectionModelViewMatrix[i] * viewMatrices[i];
+    }
+    prg->prg.setUniformValueArray(prg->projectionModelViewMatrixLoc, projectionModelViewMatrix, viewCount);
+    prg->prg.setUniformValueArray(prg->orientationMatrixLoc, orientationMatrices, viewCount);
+    prg->prg.setUniformValueArray(prg->viewOffsetXLoc, viewOffsetX, viewCount, 1);
+    prg->prg.setUniformValueArray(prg->viewFactorXLoc, viewFactorX, viewCount, 1);
+    prg->prg.setUniformValueArray(prg->viewOffsetYLoc, viewOffsetY, viewCount, 1);
+    prg->prg.setUniformValueArray(prg->viewFactorYLoc, viewFactorY, viewCount, 1);
+    prg->prg.setUniformValue(prg->relativeWidthLoc, relWidth);
+    prg->prg.setUniformValue(prg->relativeHeightLoc, relHeight);
+    // Generate the frame texture mipmap levels that will be sampled.
+    // The surround modes sample the cube map instead.
+    if (_frame.surroundMode == Surround_Off && !fusedColorConversion) {
+        TexStorage* frameTexStorage = (frameTex == _frameTex ? &_frameTexStorage : &_extFrameTexStorage);
+        int maxLevel = 0;
+        for (int i = 0; i < viewCount; i++) {
+            maxLevel = std::max(maxLevel, frameTexMaxLevel(projectionModelViewMatrix[i], texWidth, texHeight,
+                        _frame.width * viewFactorX[i], _frame.height * viewFactorY[i],
+                        relWidth, relHeight, frameTexStorage->levels));
+        }
+        updateFrameTexMipmaps(frameTex, frameTexStorage, maxLevel);
+    }
     // Render scene
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, _subtitleTex);
+    if (fusedColorConversion) {
+        for (int p = 0; p < _frameUploader.planeCount(); p++) {
+            glActiveTexture(GL_TEXTURE2 + p);
+            glBindTexture(GL_TEXTURE_2D, _frameUploader.planeTex(p));
+        }
+    }
+    if (_frame.surroundMode != Surround_Off) {
+        for (int i = 0; i < viewCount; i++) {
+            glActiveTexture(GL_TEXTURE5 + i);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, _frameCubeTex[frameCubeSlot[i]]);
+        }
+    }
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, frameTex);
     if (_frame.surroundMode != Surround_Off) {
-        // Set up filtering to work correctly at the horizontal wraparound:
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        if (_frame.surroundMode == Surround_360)
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        // Render
         glBindVertexArray(_cubeVao);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
-        // Reset filtering parameters to their defaults
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     } else {
         glBindVertexArray(_screenVao);
         glDrawElements(GL_TRIANGLES, _screen.indices.size(), GL_UNSIGNED_INT, 0);
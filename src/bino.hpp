@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include <atomic>
+
+#include <QMutex>
 #include <QOpenGLExtraFunctions>
 #include <QOpenGLShaderProgram>
 #include <QAudioDevice>
@@ -32,15 +35,35 @@
 #include <QKeyEvent>
 
 #include "screen.hpp"
+#include "rendertargetpool.hpp"
+#include "frameuploader.hpp"
+#include "framecodec.hpp"
 #include "videosink.hpp"
 #include "playlist.hpp"
 
+class UploadThread;
+class FrameRing;
 
 class Bino : public QObject, QOpenGLExtraFunctions
 {
 Q_OBJECT
 
 private:
+    typedef FrameUploader::TexStorage TexStorage;
+
+    /* A linked view program variant with its uniform locations */
+    struct ViewPrg {
+        QOpenGLShaderProgram prg;
+        int projectionModelViewMatrixLoc;
+        int orientationMatrixLoc;
+        int viewOffsetXLoc;
+        int viewFactorXLoc;
+        int viewOffsetYLoc;
+        int viewFactorYLoc;
+        int relativeWidthLoc;
+        int relativeHeightLoc;
+    };
+
     /* Data not directly relevant for rendering */
     bool _wantExit;
     VideoSink* _videoSink;
@@ -51,6 +74,17 @@ private:
     QAudioInput* _audioInput;
     QCamera* _videoInput;
     QMediaCaptureSession* _captureSession;
+    // the current playlist entry, and a counter of media changes:
+    PlaylistEntry _mediaEntry;
+    int _mediaGeneration;
+    // for local decoding in VR child processes, the drift to the main process:
+    static const qint64 _driftTolerance = 20000;        // in microseconds
+    static const qint64 _driftResyncThreshold = 100000; // in microseconds
+    unsigned long long _driftUpdates;
+    unsigned long long _driftWithinTolerance;
+    unsigned long long _driftResyncs;
+    qint64 _driftSum;
+    qint64 _driftMax;
     // for rendering subtitles:
     QImage _subtitleImg;
     QString _subtitleImgString;
@@ -62,41 +96,82 @@ private:
     Screen _screen;
 
     /* Static data for rendering, initialized in initProcess() */
-    unsigned int _depthTex;
-    unsigned int _frameFbo;
-    unsigned int _viewFbo;
-    unsigned int _quadVao;
+    bool _haveAnisotropicFiltering;
+    bool _haveTexStorage;
+    RenderTargetPool _renderTargetPool;
+    FrameUploader _frameUploader;
     unsigned int _cubeVao;
-    unsigned int _planeTexs[3];
     unsigned int _frameTex;
+    TexStorage _frameTexStorage;
     unsigned int _extFrameTex;
+    TexStorage _extFrameTexStorage;
     unsigned int _subtitleTex;
     unsigned int _screenVao;
-    QOpenGLShaderProgram _colorPrg;
-    int _colorPrgPlaneFormat;
-    bool _colorPrgYuvValueRangeSmall;
-    int _colorPrgYuvSpace;
-    QOpenGLShaderProgram _viewPrg;
-    SurroundMode _viewPrgSurroundMode;
-    bool _viewPrgNonlinearOutput;
+    QHash<int, ViewPrg*> _viewPrgs;               // linked variants, see viewPrg()
+    unsigned int _frameCubeTex[2];                // surround frame projected into a cube map, per eye
+    TexStorage _frameCubeTexStorage[2];
+    unsigned int _frameCubeFbo;
+    QOpenGLShaderProgram* _frameCubePrg;
 
     /* Dynamic data for rendering */
+    QMutex _renderMutex; // protects the dynamic data when rendering in a separate thread
+    FrameQueue _frameQueue; // frames from the video sink that were not selected yet
     VideoFrame _frame;
     VideoFrame _extFrame; // for alternating stereo
     bool _frameIsNew;
+    // (the following are written by the upload thread, if there is one)
+    std::atomic<unsigned long long> _framesDropped;  // number of queued frames that were never shown
+    std::atomic<unsigned long long> _framesRepeated; // number of display updates during playback without a new frame
     bool _swapEyes;
+    UploadThread* _uploadThread; // optional background frame upload, only in GUI mode
+    enum FrameTransport {        // how frames get to VR child processes
+        Transport_Stream,        // frame data in the dynamic data stream
+        Transport_SharedMemory,  // frame data in shared memory, see FrameRing
+        Transport_Compressed,    // compressed frame data in the stream, see FrameCodec
+        Transport_LocalDecoding  // only the playback state; each process decodes the media itself
+    };
+    FrameTransport _frameTransport;
+    FrameRing* _frameRing;       // optional shared memory frame transport, only in VR mode
+    FrameCodec* _frameCodec;     // optional compressed frame transport, only in VR mode
+    bool _regionUpload;          // upload only the tiles of the frame that are visible
+    float _fisheyeFieldOfView;   // lens field of view of fisheye surround video, in degrees
+    FrameTiles _neededTiles;     // frame tiles sampled by the views since the last upload
+    FrameTiles _uploadedTiles;   // frame tiles of the last upload
 
-    void rebuildColorPrgIfNecessary(int planeFormat, bool yuvValueRangeSmall, int yuvSpace);
-    void rebuildViewPrgIfNecessary(SurroundMode surroundMode, bool nonLinearOutput);
+    ViewPrg* viewPrg(SurroundMode surroundMode, bool nonLinearOutput,
+            int fusedPlaneFormat, bool yuvValueRangeSmall, int yuvSpace, bool layered);
     bool drawSubtitleToImage(int w, int h, const QString& string);
-    void convertFrameToTexture(const VideoFrame& frame, unsigned int frameTex);
+    void serializeFrame(QDataStream& ds, const VideoFrame& frame, int stream) const;
+    void deserializeFrame(QDataStream& ds, VideoFrame& frame, int stream);
+    void serializePlaybackState(QDataStream& ds) const;
+    void deserializePlaybackState(QDataStream& ds);
+    void logDrift() const;
+    void setPlayerSource(const PlaylistEntry& entry);
+    void updateFrameTexMipmaps(unsigned int frameTex, TexStorage* frameTexStorage, int maxLevel);
+    void createFrameCubeTexture(int slot);
+    void updateFrameCube(int slot, unsigned int frameTex, int frameViewWidth,
+            float viewOffsetX, float viewFactorX, float viewOffsetY, float viewFactorY);
+    void renderViews(int viewCount, const int* views,
+            const QMatrix4x4* projectionMatrices,
+            const QMatrix4x4* orientationMatrices,
+            const QMatrix4x4* viewMatrices,
+            int texWidth, int texHeight, unsigned int texture, int textureLayer);
+    int frameTexMaxLevel(const QMatrix4x4& projectionModelViewMatrix,
+            int texWidth, int texHeight, int frameViewWidth, int frameViewHeight,
+            float relWidth, float relHeight, int levels) const;
 
 public:
-    Bino(const Screen& screen, bool swapEyes);
+    Bino(const Screen& screen, bool swapEyes, bool uploadThread = false,
+            bool vrSharedMemory = false, FrameCodec::Method vrFrameCompression = FrameCodec::Method_None,
+            bool vrLocalDecoding = false, bool regionUpload = false,
+            float fisheyeFieldOfView = 180.0f);
     virtual ~Bino();
 
     static Bino* instance();
 
+    // The render target pool of the current OpenGL context; valid after initProcess()
+    RenderTargetPool* renderTargetPool();
+
     /* Initialization functions, to be called by main() before
      * starting either GUI or VR mode */
     void initializeOutput(const QAudioDevice& audioOutputDevice);
@@ -154,10 +229,28 @@ public:
     bool wantExit() const;
 
     /* Functions shared by GUI and VR mode */
+    // Choose the queued video frame to show next, given the delay in
+    // microseconds until the rendered image will become visible. Only the
+    // process that owns the media player calls this. Returns true if frames
+    // remain queued, in which case another update should be scheduled.
+    bool selectFrame(qint64 presentationDelay = 0);
+    // The same in two steps, for rendering in a separate thread: the media
+    // time is determined in the GUI thread, the frame is selected in the
+    // render thread. The media time is -1 if no timing is available.
+    qint64 frameSelectionTime(qint64 presentationDelay) const;
+    bool selectFrameAt(qint64 mediaTime);
+    // Take the frame for the given media time from the queue, swapping it
+    // into the given frames. Returns false if no queued frame is due; sets
+    // framesPending if frames remain queued. Used by the upload thread.
+    bool takeFrameFromQueue(qint64 mediaTime, VideoFrame* frame, VideoFrame* extFrame, bool* framesPending);
+    // The mutex that a separate render thread holds while it selects and renders
+    // frames; functions that change the dynamic data for rendering lock it, too.
+    QMutex* renderMutex();
     bool initProcess();
     void preRenderProcess(
             int screenWidth = 0,
             int screenHeight = 0,
+            int subtitleTrack = -1,
             int* viewCount = nullptr,
             int* viewWidth = nullptr,
             int* viewHeight = nullptr,
@@ -168,6 +261,16 @@ public:
             const QMatrix4x4& orientationMatrix,
             const QMatrix4x4& viewMatrix,
             int view, // 0 = left, 1 = right
+            int texWidth, int texHeight, unsigned int texture,
+            int textureLayer = RenderTargetPool::NoLayer);
+    // Render both views into the two layers of the given 2D array texture in
+    // a single pass, with per-view matrices. This is only possible for
+    // intermediate view textures and input modes that have both views in one
+    // frame; if it returns false, render the views separately instead.
+    bool renderStereo(
+            const QMatrix4x4* projectionMatrices,
+            const QMatrix4x4* orientationMatrices,
+            const QMatrix4x4* viewMatrices,
             int texWidth, int texHeight, unsigned int texture);
     void keyPressEvent(QKeyEvent* event);
 
@@ -0,0 +1,207 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include <QElapsedTimer>
+
+#include "framecodec.hpp"
+#include "log.hpp"
+
+
+FrameCodec::FrameCodec(Method method) :
+    _method(method),
+    _frames(0),
+    _rawBytes(0),
+    _codedBytes(0),
+    _nanoseconds(0),
+    _encoding(false)
+{
+}
+
+FrameCodec::~FrameCodec()
+{
+    if (_frames > 0)
+        logStatistics();
+}
+
+void FrameCodec::logStatistics()
+{
+    LOG_DEBUG("frame codec: %s %llu frames, ratio %.2f, %.2f ms per frame",
+            _encoding ? "encoded" : "decoded", _frames,
+            _codedBytes > 0 ? double(_rawBytes) / double(_codedBytes) : 0.0,
+            _nanoseconds / 1e6 / _frames);
+}
+
+static void xorBlock(uchar* dst, const uchar* a, const uchar* b, qsizetype size)
+{
+    for (qsizetype i = 0; i < size; i++)
+        dst[i] = a[i] ^ b[i];
+}
+
+void FrameCodec::encode(QDataStream& ds, const VideoFrame& frame, int stream)
+{
+    QElapsedTimer timer;
+    timer.start();
+    _encoding = true;
+
+    ds << static_cast<int>(_method);
+    frame.serialize(ds, false);
+    int planeCount = (frame.storage == VideoFrame::Storage_Image ? 1 : frame.planeCount);
+    const uchar* planeData[3];
+    qsizetype planeSize[3];
+    bool delta[3];
+    for (int p = 0; p < planeCount; p++) {
+        if (frame.storage == VideoFrame::Storage_Image) {
+            planeData[p] = frame.image.constBits();
+            planeSize[p] = frame.image.sizeInBytes();
+        } else {
+            planeData[p] = frame.planeData(p);
+            planeSize[p] = frame.bytesPerPlane[p];
+        }
+        delta[p] = (_method == Method_Delta && qsizetype(_previous[stream][p].size()) == planeSize[p]);
+    }
+
+    // Compress all blocks of all planes in parallel
+    QList<QByteArray> blocks[3];
+    for (int p = 0; p < planeCount; p++) {
+        int blockCount = (planeSize[p] + blockSize - 1) / blockSize;
+        blocks[p].resize(blockCount);
+        QByteArray* blockData = blocks[p].data();
+        for (int b = 0; b < blockCount; b++) {
+            _threadPool.start([=]() {
+                qsizetype offset = b * blockSize;
+                qsizetype size = std::min(blockSize, planeSize[p] - offset);
+                const uchar* data = planeData[p] + offset;
+                if (delta[p]) {
+                    const uchar* previous = _previous[stream][p].data() + offset;
+                    if (std::memcmp(data, previous, size) == 0)
+                        return; // unchanged: send an empty block
+                    QByteArray diff(size, Qt::Uninitialized);
+                    xorBlock(reinterpret_cast<uchar*>(diff.data()), data, previous, size);
+                    blockData[b] = qCompress(diff, 1);
+                } else {
+                    blockData[b] = qCompress(data, size, 1);
+                }
+            });
+        }
+    }
+    _threadPool.waitForDone();
+
+    for (int p = 0; p < planeCount; p++) {
+        ds << delta[p];
+        ds << blocks[p];
+        _rawBytes += planeSize[p];
+        for (int b = 0; b < blocks[p].size(); b++)
+            _codedBytes += blocks[p][b].size();
+        if (_method == Method_Delta) {
+            _previous[stream][p].resize(planeSize[p]);
+            std::memcpy(_previous[stream][p].data(), planeData[p], planeSize[p]);
+        }
+    }
+
+    _nanoseconds += timer.nsecsElapsed();
+    _frames++;
+    if (_frames % 1000 == 0)
+        logStatistics();
+}
+
+void FrameCodec::decode(QDataStream& ds, VideoFrame& frame, int stream)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int tmp;
+    ds >> tmp;
+    Method method = static_cast<Method>(tmp);
+    frame.deserialize(ds, false);
+    if (ds.status() != QDataStream::Ok)
+        return;
+    int planeCount = (frame.storage == VideoFrame::Storage_Image ? 1 : frame.planeCount);
+    if (frame.storage == VideoFrame::Storage_Image)
+        frame.image = QImage(frame.width, frame.height, QImage::Format_RGB32);
+    uchar* planeData[3];
+    qsizetype planeSize[3];
+    bool delta[3];
+    QList<QByteArray> blocks[3];
+    for (int p = 0; p < planeCount; p++) {
+        if (frame.storage == VideoFrame::Storage_Image) {
+            planeData[p] = frame.image.bits();
+            planeSize[p] = frame.image.sizeInBytes();
+        } else {
+            frame.bits[p].resize(frame.bytesPerPlane[p]);
+            planeData[p] = frame.bits[p].data();
+            planeSize[p] = frame.bytesPerPlane[p];
+        }
+        ds >> delta[p];
+        ds >> blocks[p];
+        if (ds.status() != QDataStream::Ok || blocks[p].size() != (planeSize[p] + blockSize - 1) / blockSize) {
+            LOG_WARNING("frame codec: invalid frame data");
+            ds.setStatus(QDataStream::ReadCorruptData);
+            frame.update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
+            return;
+        }
+        if (delta[p] && qsizetype(_previous[stream][p].size()) != planeSize[p]) {
+            LOG_WARNING("frame codec: missing previous frame for delta decoding");
+            delta[p] = false;
+        }
+    }
+
+    // Decompress all blocks of all planes in parallel
+    for (int p = 0; p < planeCount; p++) {
+        const QByteArray* blockData = blocks[p].constData();
+        for (int b = 0; b < blocks[p].size(); b++) {
+            _threadPool.start([=]() {
+                qsizetype offset = b * blockSize;
+                qsizetype size = std::min(blockSize, planeSize[p] - offset);
+                uchar* data = planeData[p] + offset;
+                if (delta[p]) {
+                    uchar* previous = _previous[stream][p].data() + offset;
+                    if (!blockData[b].isEmpty()) {
+                        QByteArray diff = qUncompress(blockData[b]);
+                        if (diff.size() == size)
+                            xorBlock(previous, previous, reinterpret_cast<const uchar*>(diff.constData()), size);
+                    }
+                    std::memcpy(data, previous, size);
+                } else {
+                    QByteArray block = qUncompress(blockData[b]);
+                    if (block.size() == size)
+                        std::memcpy(data, block.constData(), size);
+                }
+            });
+        }
+    }
+    _threadPool.waitForDone();
+
+    for (int p = 0; p < planeCount; p++) {
+        _rawBytes += planeSize[p];
+        for (int b = 0; b < blocks[p].size(); b++)
+            _codedBytes += blocks[p][b].size();
+        if (method == Method_Delta && !delta[p]) {
+            _previous[stream][p].resize(planeSize[p]);
+            std::memcpy(_previous[stream][p].data(), planeData[p], planeSize[p]);
+        }
+    }
+
+    _nanoseconds += timer.nsecsElapsed();
+    _frames++;
+    if (_frames % 1000 == 0)
+        logStatistics();
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <QDataStream>
+#include <QThreadPool>
+
+#include "videoframe.hpp"
+
+
+/* Compression of video frame data for VR child processes on other hosts.
+ * Each plane is split into blocks that are compressed independently and in
+ * parallel. In delta mode, a block is XORed with the same block of the
+ * previous frame of the same stream first, so that unchanged image regions
+ * become zero and compress very well; unchanged blocks are not sent at all.
+ * A stream is a sequence of frames that are deltas of each other, e.g. the
+ * frames and the extended frames of alternating stereo.
+ * The main process and all child processes keep the previous frames of each
+ * stream, so every frame of a stream must be encoded and decoded in order. */
+class FrameCodec
+{
+public:
+    enum Method {
+        Method_None,     // no compression
+        Method_Compress, // compress every block
+        Method_Delta     // compress the difference to the previous frame
+    };
+
+    static const int streamCount = 2;
+
+private:
+    static const qsizetype blockSize = 1 << 20;
+
+    QThreadPool _threadPool;
+    Method _method;
+    std::vector<uchar> _previous[streamCount][3]; // previous plane data of each stream
+    // Statistics:
+    unsigned long long _frames;
+    unsigned long long _rawBytes;
+    unsigned long long _codedBytes;
+    qint64 _nanoseconds;
+    bool _encoding;
+
+    void logStatistics();
+
+public:
+    FrameCodec(Method method = Method_None);
+    ~FrameCodec();
+
+    // Main process: serialize the frame with compressed data
+    void encode(QDataStream& ds, const VideoFrame& frame, int stream);
+    // Child process: deserialize a frame that was encoded with encode()
+    void decode(QDataStream& ds, VideoFrame& frame, int stream);
+};
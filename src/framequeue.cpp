@@ -0,0 +1,100 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "framequeue.hpp"
+
+
+FrameQueue::FrameQueue() :
+    _head(0),
+    _tail(0)
+{
+    _guard.clear();
+}
+
+FrameQueue::Entry* FrameQueue::producerEntry()
+{
+    // The entry at the tail is never published, so it is always free
+    return &(_entries[_tail.load(std::memory_order_relaxed)]);
+}
+
+bool FrameQueue::publish()
+{
+    int tail = _tail.load(std::memory_order_relaxed);
+    int nextTail = (tail + 1) % (capacity + 1);
+    bool dropped = false;
+    if (nextTail == _head.load(std::memory_order_acquire)) {
+        // The queue is full. Drop the oldest entry if the consumer does not
+        // currently use it, otherwise drop the new entry by not publishing it.
+        if (_guard.test_and_set(std::memory_order_acquire))
+            return true;
+        int head = _head.load(std::memory_order_relaxed);
+        if (nextTail == head) {
+            _head.store((head + 1) % (capacity + 1), std::memory_order_release);
+            dropped = true;
+        }
+        _guard.clear(std::memory_order_release);
+    }
+    _tail.store(nextTail, std::memory_order_release);
+    return dropped;
+}
+
+void FrameQueue::clear()
+{
+    while (_guard.test_and_set(std::memory_order_acquire))
+        ;
+    int head = _head.load(std::memory_order_relaxed);
+    int tail = _tail.load(std::memory_order_relaxed);
+    for (int i = head; i != tail; i = (i + 1) % (capacity + 1)) {
+        _entries[i].frame.invalidate();
+        _entries[i].extFrame.invalidate();
+    }
+    _head.store(tail, std::memory_order_release);
+    _guard.clear(std::memory_order_release);
+}
+
+void FrameQueue::beginConsume()
+{
+    while (_guard.test_and_set(std::memory_order_acquire))
+        ;
+}
+
+void FrameQueue::endConsume()
+{
+    _guard.clear(std::memory_order_release);
+}
+
+int FrameQueue::size() const
+{
+    int head = _head.load(std::memory_order_relaxed);
+    int tail = _tail.load(std::memory_order_acquire);
+    return (tail - head + capacity + 1) % (capacity + 1);
+}
+
+FrameQueue::Entry* FrameQueue::consumerEntry(int i)
+{
+    int head = _head.load(std::memory_order_relaxed);
+    return &(_entries[(head + i) % (capacity + 1)]);
+}
+
+void FrameQueue::pop()
+{
+    int head = _head.load(std::memory_order_relaxed);
+    _head.store((head + 1) % (capacity + 1), std::memory_order_release);
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "videoframe.hpp"
+
+
+/* A bounded single-producer / single-consumer ring of video frames.
+ * The producer (the video sink) fills the entry returned by producerEntry()
+ * and then calls publish(). If the queue is full, publishing drops the
+ * oldest entry, so that the renderer always gets the newest frames.
+ * The consumer (the renderer) looks at published entries with consumerEntry()
+ * and removes them with pop(), between beginConsume() and endConsume().
+ * Entries are reused, so the consumer should swap frames out of an entry
+ * instead of copying them; the producer then recycles the swapped-in frame.
+ *
+ * The producer never waits for the consumer: if the consumer is busy while
+ * the queue is full, the new entry is dropped instead of the oldest one. */
+class FrameQueue
+{
+public:
+    struct Entry {
+        VideoFrame frame;
+        VideoFrame extFrame;      // for alternating stereo
+        qint64 presentationTime;  // in microseconds, or -1 if unknown
+        qint64 duration;          // in microseconds, or -1 if unknown
+        qint64 arrivalTime;       // in nanoseconds, on the clock of the video sink
+    };
+
+    static const int capacity = 4;
+
+private:
+    Entry _entries[capacity + 1]; // one entry is always unused to distinguish full from empty
+    std::atomic<int> _head;       // next entry to consume; written by the consumer, or by the producer while it holds the guard
+    std::atomic<int> _tail;       // next entry to produce; written by the producer
+    std::atomic_flag _guard;      // held by the consumer while it uses entries, and by the producer while it drops them
+
+public:
+    FrameQueue();
+
+    // Producer side: return the entry to fill next. It is not visible to the
+    // consumer until publish() is called.
+    Entry* producerEntry();
+    // Producer side: make the entry returned by producerEntry() available to
+    // the consumer. Return whether a frame had to be dropped for that.
+    bool publish();
+    // Producer side: drop all published entries, e.g. when new media is opened
+    void clear();
+
+    // Consumer side: guard the use of entries against drops by the producer
+    void beginConsume();
+    void endConsume();
+    // Consumer side: return the number of published entries
+    int size() const;
+    // Consumer side: return the i-th oldest published entry
+    Entry* consumerEntry(int i);
+    // Consumer side: remove the oldest published entry
+    void pop();
+};
@@ -0,0 +1,210 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include <QCoreApplication>
+
+#include "framering.hpp"
+#include "log.hpp"
+
+
+FrameRing::FrameRing() :
+    _generation(0),
+    _slotSize(0),
+    _nextSlot(0),
+    _sequence(0)
+{
+    for (int i = 0; i < slotCount; i++)
+        _slotSequences[i] = 0;
+}
+
+static qsizetype alignUp(qsizetype size, qsizetype alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+qsizetype FrameRing::dataSize(const VideoFrame& frame, qsizetype planeOffsets[3])
+{
+    qsizetype size = 0;
+    if (frame.storage == VideoFrame::Storage_Image) {
+        planeOffsets[0] = 0;
+        size = frame.image.sizeInBytes();
+    } else {
+        for (int p = 0; p < frame.planeCount; p++) {
+            planeOffsets[p] = size;
+            size += alignUp(frame.bytesPerPlane[p], alignment);
+        }
+    }
+    return alignUp(size, alignment);
+}
+
+std::atomic<quint32>* FrameRing::slotSequence(int slot) const
+{
+    static_assert(std::atomic<quint32>::is_always_lock_free, "atomics in shared memory must be lock free");
+    uchar* slotData = static_cast<uchar*>(const_cast<void*>(_sharedMemory.constData())) + slot * _slotSize;
+    return reinterpret_cast<std::atomic<quint32>*>(slotData);
+}
+
+bool FrameRing::resize(qsizetype slotSize)
+{
+    if (_sharedMemory.isAttached())
+        _sharedMemory.detach();
+    _generation++;
+    QString key = QString("bino-frames-%1-%2").arg(QCoreApplication::applicationPid()).arg(_generation);
+    _sharedMemory.setKey(key);
+    if (!_sharedMemory.create(slotCount * slotSize)) {
+        LOG_WARNING("cannot create shared memory for video frames: %s",
+                qPrintable(_sharedMemory.errorString()));
+        _slotSize = 0;
+        return false;
+    }
+    LOG_DEBUG("frame ring: created shared memory %s with %d slots of %lld bytes",
+            qPrintable(key), slotCount, static_cast<long long>(slotSize));
+    _slotSize = slotSize;
+    _nextSlot = 0;
+    return true;
+}
+
+bool FrameRing::attach(const QString& key, qsizetype slotSize)
+{
+    if (_sharedMemory.isAttached() && _sharedMemory.key() == key)
+        return true;
+    if (_sharedMemory.isAttached())
+        _sharedMemory.detach();
+    _sharedMemory.setKey(key);
+    if (!_sharedMemory.attach(QSharedMemory::ReadOnly)) {
+        LOG_FATAL("cannot attach to shared memory for video frames: %s",
+                qPrintable(_sharedMemory.errorString()));
+        return false;
+    }
+    LOG_DEBUG("frame ring: attached to shared memory %s", qPrintable(key));
+    _slotSize = slotSize;
+    return true;
+}
+
+void FrameRing::serialize(QDataStream& ds, const VideoFrame& frame)
+{
+    qsizetype planeOffsets[3] = { 0, 0, 0 };
+    qsizetype size = slotHeaderSize + dataSize(frame, planeOffsets);
+    if (size > _slotSize && !resize(size)) {
+        // Fall back to sending the data through the stream
+        ds << false;
+        ds << frame;
+        return;
+    }
+    int slot = _nextSlot;
+    _nextSlot = (_nextSlot + 1) % slotCount;
+    uchar* slotData = static_cast<uchar*>(_sharedMemory.data()) + slot * _slotSize + slotHeaderSize;
+    // An odd sequence number marks the slot as being written
+    std::atomic<quint32>* sequence = slotSequence(slot);
+    _sequence += 2;
+    sequence->store(_sequence - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (frame.storage == VideoFrame::Storage_Image) {
+        std::memcpy(slotData, frame.image.constBits(), frame.image.sizeInBytes());
+    } else {
+        for (int p = 0; p < frame.planeCount; p++)
+            std::memcpy(slotData + planeOffsets[p], frame.planeData(p), frame.bytesPerPlane[p]);
+    }
+    sequence->store(_sequence, std::memory_order_release);
+    ds << true;
+    ds << _sharedMemory.key();
+    ds << static_cast<qint64>(_slotSize);
+    ds << slot;
+    ds << _sequence;
+    // Children wrap image data as it is, so they need its format and stride
+    bool isImage = (frame.storage == VideoFrame::Storage_Image);
+    ds << isImage;
+    if (isImage) {
+        ds << static_cast<int>(frame.image.format());
+        ds << static_cast<qint64>(frame.image.bytesPerLine());
+    }
+    frame.serialize(ds, false);
+}
+
+void FrameRing::deserialize(QDataStream& ds, VideoFrame& frame)
+{
+    bool inSharedMemory;
+    ds >> inSharedMemory;
+    if (!inSharedMemory) {
+        ds >> frame;
+        return;
+    }
+    QString key;
+    qint64 slotSize;
+    int slot;
+    quint32 sequence;
+    int imageFormat = QImage::Format_Invalid;
+    qint64 imageBytesPerLine = 0;
+    bool isImage;
+    ds >> key >> slotSize >> slot >> sequence >> isImage;
+    if (isImage)
+        ds >> imageFormat >> imageBytesPerLine;
+    frame.deserialize(ds, false);
+    if (ds.status() != QDataStream::Ok || slot < 0 || slot >= slotCount)
+        return;
+    qsizetype planeOffsets[3] = { 0, 0, 0 };
+    bool valid;
+    if (frame.storage == VideoFrame::Storage_Image) {
+        // See VideoFrame::prepareData() for the image formats
+        valid = ((imageFormat == QImage::Format_RGB32
+                    || imageFormat == QImage::Format_ARGB32
+                    || imageFormat == QImage::Format_ARGB32_Premultiplied)
+                && imageBytesPerLine >= 4 * qint64(frame.width)
+                && slotHeaderSize + imageBytesPerLine * frame.height <= slotSize);
+    } else {
+        valid = (slotHeaderSize + dataSize(frame, planeOffsets) <= slotSize);
+    }
+    if (!valid) {
+        LOG_WARNING("invalid video frame data in shared memory");
+        frame.update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
+        return;
+    }
+    if (!attach(key, slotSize))
+        return;
+    _slotSequences[slot] = sequence;
+    const uchar* slotData = static_cast<const uchar*>(_sharedMemory.constData()) + slot * _slotSize + slotHeaderSize;
+    if (frame.storage == VideoFrame::Storage_Image) {
+        // Wrap the shared memory without copying it, with the format and
+        // the line stride of the image in the main process
+        frame.image = QImage(slotData, frame.width, frame.height, imageBytesPerLine,
+                static_cast<QImage::Format>(imageFormat));
+    } else {
+        frame.storage = VideoFrame::Storage_Mapped;
+        for (int p = 0; p < frame.planeCount; p++)
+            frame.mappedBits[p] = const_cast<uchar*>(slotData + planeOffsets[p]);
+    }
+}
+
+bool FrameRing::dataIsIntact(const VideoFrame& frame) const
+{
+    if (!_sharedMemory.isAttached() || _slotSize <= 0)
+        return true;
+    const uchar* data = (frame.storage == VideoFrame::Storage_Image ? frame.image.constBits()
+            : frame.storage == VideoFrame::Storage_Mapped ? frame.mappedBits[0] : nullptr);
+    const uchar* segment = static_cast<const uchar*>(_sharedMemory.constData());
+    if (!data || data < segment || data >= segment + slotCount * _slotSize)
+        return true; // the data is not in the ring
+    int slot = (data - segment) / _slotSize;
+    // Order the reads of the data before the read of the sequence number
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slotSequence(slot)->load(std::memory_order_relaxed) == _slotSequences[slot];
+}
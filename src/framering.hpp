@@ -0,0 +1,76 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include <QSharedMemory>
+#include <QDataStream>
+
+#include "videoframe.hpp"
+
+
+/* A ring of video frames in shared memory, for VR processes on the same host.
+ * The main process copies the data of each new frame once into the next slot,
+ * and only serializes the frame properties, the shared memory key and the slot.
+ * Child processes attach to the shared memory and upload the data directly
+ * from there, without copying it into their own memory first.
+ *
+ * Child processes normally finish uploading a frame before the main process
+ * serializes the next one, so with more than two slots the main process does
+ * not overwrite data that is still in use. Since nothing enforces this, each
+ * slot starts with a sequence number that the main process changes before
+ * and after it writes the slot, and child processes check with
+ * dataIsIntact() that it did not change while they read the data. */
+class FrameRing
+{
+private:
+    static const int slotCount = 3;
+    static const qsizetype alignment = 64;
+    static const qsizetype slotHeaderSize = alignment; // holds the sequence number
+
+    QSharedMemory _sharedMemory;
+    int _generation;       // incremented each time the segment is recreated with a larger size
+    qsizetype _slotSize;   // in bytes, including the slot header
+    int _nextSlot;
+    quint32 _sequence;     // main process: sequence number of the last written slot
+    quint32 _slotSequences[slotCount]; // child process: sequence numbers of the received slots
+
+    bool resize(qsizetype slotSize);
+    bool attach(const QString& key, qsizetype slotSize);
+    static qsizetype dataSize(const VideoFrame& frame, qsizetype planeOffsets[3]);
+    std::atomic<quint32>* slotSequence(int slot) const;
+
+public:
+    FrameRing();
+
+    // Main process: copy the frame data into the next slot and serialize
+    // everything that is needed to access it in a child process.
+    void serialize(QDataStream& ds, const VideoFrame& frame);
+    // Child process: deserialize the frame, with its data pointers referring
+    // to the shared memory. The data stays valid until the main process
+    // reuses the slot.
+    void deserialize(QDataStream& ds, VideoFrame& frame);
+    // Child process: check that the main process did not reuse the slot of
+    // the frame since it was deserialized. Call this after the frame data
+    // was read, e.g. after the upload; if it fails, the data read may be torn.
+    bool dataIsIntact(const VideoFrame& frame) const;
+};
@@ -0,0 +1,100 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "frametiles.hpp"
+
+
+FrameTiles::FrameTiles() : _mask(0)
+{
+}
+
+FrameTiles FrameTiles::all()
+{
+    FrameTiles tiles;
+    tiles._mask = ~quint64(0);
+    return tiles;
+}
+
+bool FrameTiles::isEmpty() const
+{
+    return _mask == 0;
+}
+
+bool FrameTiles::isFull() const
+{
+    return _mask == ~quint64(0);
+}
+
+int FrameTiles::count() const
+{
+    int n = 0;
+    for (quint64 m = _mask; m; m &= m - 1)
+        n++;
+    return n;
+}
+
+bool FrameTiles::contains(int column, int row) const
+{
+    return _mask & (quint64(1) << (row * columns + column));
+}
+
+bool FrameTiles::contains(const FrameTiles& tiles) const
+{
+    return (_mask & tiles._mask) == tiles._mask;
+}
+
+bool FrameTiles::containsRow(int row) const
+{
+    return (_mask >> (row * columns)) & ((quint64(1) << columns) - 1);
+}
+
+void FrameTiles::add(int column, int row)
+{
+    _mask |= quint64(1) << (row * columns + column);
+}
+
+void FrameTiles::add(const QRectF& region)
+{
+    if (region.isEmpty())
+        return;
+    int c0 = std::clamp(int(std::floor(region.left() * columns)), 0, columns - 1);
+    int c1 = std::clamp(int(std::ceil(region.right() * columns)) - 1, c0, columns - 1);
+    int r0 = std::clamp(int(std::floor(region.top() * rows)), 0, rows - 1);
+    int r1 = std::clamp(int(std::ceil(region.bottom() * rows)) - 1, r0, rows - 1);
+    for (int r = r0; r <= r1; r++)
+        for (int c = c0; c <= c1; c++)
+            add(c, r);
+}
+
+void FrameTiles::add(const FrameTiles& tiles)
+{
+    _mask |= tiles._mask;
+}
+
+void FrameTiles::texelRange(int size, int tiles, int first, int n, int* begin, int* count)
+{
+    int b = std::max(first * size / tiles - 1, 0);
+    int e = std::min((first + n) * size / tiles + 1, size);
+    *begin = b;
+    *count = std::max(e - b, 0);
+}
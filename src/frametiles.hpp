@@ -0,0 +1,62 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <QRectF>
+
+
+/* A set of tiles of a video frame, on a fixed grid over the texture
+ * coordinates: column 0 starts at s = 0, row 0 starts at t = 0. Frame
+ * uploads are restricted to such a set, see FrameUploader::setTiles(). */
+class FrameTiles
+{
+public:
+    static const int columns = 8;
+    static const int rows = 8;
+
+private:
+    quint64 _mask;
+
+public:
+    // An empty set
+    FrameTiles();
+    // The set of all tiles
+    static FrameTiles all();
+
+    bool isEmpty() const;
+    bool isFull() const;
+    int count() const;
+    bool contains(int column, int row) const;
+    bool contains(const FrameTiles& tiles) const;
+    // Check if the row contains any tile
+    bool containsRow(int row) const;
+
+    void add(int column, int row);
+    // Add all tiles that intersect the region (in texture coordinates)
+    void add(const QRectF& region);
+    void add(const FrameTiles& tiles);
+
+    // The range of texels that the tiles first to first + n - 1 of an axis
+    // with the given number of tiles cover in a texture of the given size,
+    // plus a margin of one texel for linear filtering
+    static void texelRange(int size, int tiles, int first, int n, int* begin, int* count);
+};
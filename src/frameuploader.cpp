@@ -0,0 +1,631 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "frameuploader.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+FrameUploader::FrameUploader() :
+    _renderTargetPool(nullptr),
+    _pboRingIndex(0),
+    _pboRingUploads(0),
+    _pboRingStalls(0),
+    _tiles(FrameTiles::all())
+{
+}
+
+FrameUploader::~FrameUploader()
+{
+    if (_pboRingUploads > 0) {
+        LOG_DEBUG("PBO ring: %llu uploads, %llu stalls", _pboRingUploads, _pboRingStalls);
+    }
+    qDeleteAll(_colorPrgs);
+}
+
+void FrameUploader::initialize(RenderTargetPool* renderTargetPool)
+{
+    initializeOpenGLFunctions();
+    _haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+    _haveTexStorage = checkTextureStorageAvailability();
+    LOG_DEBUG("Using %s texture storage", _haveTexStorage ? "immutable" : "mutable");
+    _renderTargetPool = renderTargetPool;
+
+    // Quad geometry
+    const float quadPositions[] = {
+        -1.0f, +1.0f, 0.0f,
+        +1.0f, +1.0f, 0.0f,
+        +1.0f, -1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f
+    };
+    const float quadTexCoords[] = {
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+        1.0f, 0.0f,
+        0.0f, 0.0f
+    };
+    static const unsigned short quadIndices[] = {
+        0, 3, 1, 1, 3, 2
+    };
+    glGenVertexArrays(1, &_quadVao);
+    glBindVertexArray(_quadVao);
+    GLuint quadPositionBuf;
+    glGenBuffers(1, &quadPositionBuf);
+    glBindBuffer(GL_ARRAY_BUFFER, quadPositionBuf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadPositions), quadPositions, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    GLuint quadTexCoordBuf;
+    glGenBuffers(1, &quadTexCoordBuf);
+    glBindBuffer(GL_ARRAY_BUFFER, quadTexCoordBuf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadTexCoords), quadTexCoords, GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(1);
+    GLuint quadIndexBuf;
+    glGenBuffers(1, &quadIndexBuf);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuf);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
+    CHECK_GL();
+
+    // Plane textures, and their low resolution counterparts for tiled uploads
+    glGenTextures(3, _planeTexs);
+    glGenTextures(3, _fallbackPlaneTexs);
+    for (int i = 0; i < 6; i++) {
+        int p = i % 3;
+        glBindTexture(GL_TEXTURE_2D, i < 3 ? _planeTexs[p] : _fallbackPlaneTexs[p]);
+        unsigned int black = 0;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 1, 1, 0, GL_RED, GL_UNSIGNED_BYTE, &black);
+        (i < 3 ? _planeTexStorages[p] : _fallbackPlaneTexStorages[p]) = { GL_R8, 1, 1, 1 };
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (p == 0) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        } else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+    }
+    _planeFormat = 1;
+    _planeCount = 1;
+    CHECK_GL();
+
+    // Pixel buffer objects for plane uploads
+    glGenBuffers(_pboRingSize, _pboRing);
+    for (int i = 0; i < _pboRingSize; i++) {
+        _pboRingFences[i] = nullptr;
+        _pboRingBufferSizes[i] = 0;
+    }
+    CHECK_GL();
+}
+
+void FrameUploader::createFrameTexture(unsigned int* frameTex, TexStorage* frameTexStorage)
+{
+    glGenTextures(1, frameTex);
+    *frameTexStorage = { 0, 0, 0, 0, 0 };
+    glBindTexture(GL_TEXTURE_2D, *frameTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    if (_haveAnisotropicFiltering)
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
+}
+
+unsigned int FrameUploader::planeTex(int plane) const
+{
+    return _planeTexs[plane];
+}
+
+int FrameUploader::planeFormat() const
+{
+    return _planeFormat;
+}
+
+int FrameUploader::planeCount() const
+{
+    return _planeCount;
+}
+
+QString FrameUploader::colorConversionSource(int planeFormat, bool yuvValueRangeSmall, int yuvSpace)
+{
+    QString src = readFile(":src/shader-color-conversion.glsl");
+    src.replace("$PLANE_FORMAT", QString::number(planeFormat));
+    src.replace("$VALUE_RANGE_SMALL", yuvValueRangeSmall ? "true" : "false");
+    src.replace("$YUV_SPACE", QString::number(yuvSpace));
+    return src;
+}
+
+QOpenGLShaderProgram* FrameUploader::colorPrg(int planeFormat, bool yuvValueRangeSmall, int yuvSpace)
+{
+    int key = planeFormat | (yuvSpace << 8) | (yuvValueRangeSmall ? (1 << 16) : 0);
+    QOpenGLShaderProgram* prg = _colorPrgs.value(key, nullptr);
+    if (prg)
+        return prg;
+
+    LOG_DEBUG("building color conversion program for plane format %d, value range %s, yuv space %d",
+            planeFormat, yuvValueRangeSmall ? "small" : "full", yuvSpace);
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    QString colorVS = readFile(":src/shader-color.vert.glsl");
+    QString colorFS = readFile(":src/shader-color.frag.glsl");
+    colorFS.replace("$COLOR_CONVERSION", colorConversionSource(planeFormat, yuvValueRangeSmall, yuvSpace));
+    if (isGLES) {
+        colorVS.prepend("#version 320 es\n");
+        colorFS.prepend("#version 320 es\n"
+                "precision mediump float;\n");
+    } else {
+        colorVS.prepend("#version 330\n");
+        colorFS.prepend("#version 330\n");
+    }
+    prg = new QOpenGLShaderProgram;
+    // Cacheable shaders let Qt store the linked program binary on disk, keyed by
+    // the shader sources and the OpenGL vendor, renderer and version strings.
+    // Subsequent links of the same variant then skip compilation.
+    prg->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, colorVS);
+    prg->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, colorFS);
+    prg->link();
+    // The sampler uniforms never change, so set them once
+    prg->bind();
+    for (int p = 0; p < 3; p++)
+        prg->setUniformValue(qPrintable(QString("plane") + QString::number(p)), p);
+    _colorPrgs.insert(key, prg);
+    return prg;
+}
+
+std::array<const void*, 3> FrameUploader::copyPlanesToPbo(int planeCount,
+        const std::array<const void*, 3>& planeData,
+        const std::array<int, 3>& planeSize,
+        const std::array<int, 3>& planeBytesPerLine,
+        const std::array<int, 3>& planeRows,
+        int* pboSlot)
+{
+    // Use the next PBO in the ring. If the GPU is still reading from it
+    // (i.e. the upload from _pboRingSize frames ago has not finished yet),
+    // we have to wait, and we count this as a stall.
+    int slot = _pboRingIndex;
+    _pboRingIndex = (_pboRingIndex + 1) % _pboRingSize;
+    if (_pboRingFences[slot]) {
+        if (glClientWaitSync(_pboRingFences[slot], 0, 0) == GL_TIMEOUT_EXPIRED) {
+            _pboRingStalls++;
+            LOG_FIREHOSE("PBO ring stalls on slot %d (%llu stalls in %llu uploads)", slot, _pboRingStalls, _pboRingUploads);
+            while (glClientWaitSync(_pboRingFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(_pboRingFences[slot]);
+        _pboRingFences[slot] = nullptr;
+    }
+
+    // Place the planes at 64-byte aligned offsets in the buffer
+    std::array<size_t, 3> offsets = { 0, 0, 0 };
+    size_t totalSize = 0;
+    for (int p = 0; p < planeCount; p++) {
+        offsets[p] = totalSize;
+        totalSize += (size_t(planeSize[p]) + 63) & ~size_t(63);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pboRing[slot]);
+    if (_pboRingBufferSizes[slot] < totalSize) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+        _pboRingBufferSizes[slot] = totalSize;
+    }
+    // We already waited for the fence, so the mapping does not need to synchronize
+    unsigned char* ptr = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalSize,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if (!ptr) {
+        // Fall back to uploading directly from client memory
+        LOG_DEBUG("cannot map PBO, falling back to synchronous upload");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        *pboSlot = -1;
+        return planeData;
+    }
+    std::array<const void*, 3> pboData = { nullptr, nullptr, nullptr };
+    for (int p = 0; p < planeCount; p++) {
+        // Copy only the rows that uploadPlane() reads; the plane keeps its layout
+        const unsigned char* src = static_cast<const unsigned char*>(planeData[p]);
+        unsigned char* dst = ptr + offsets[p];
+        auto copyRows = [&](int firstRow, int rowCount) {
+            size_t begin = size_t(firstRow) * planeBytesPerLine[p];
+            size_t end = (firstRow + rowCount == planeRows[p]
+                    ? planeSize[p] : size_t(firstRow + rowCount) * planeBytesPerLine[p]);
+            std::memcpy(dst + begin, src + begin, end - begin);
+        };
+        if (_tiles.isFull()) {
+            copyRows(0, planeRows[p]);
+        } else {
+            for (int row = 0; row < FrameTiles::rows; row++) {
+                int firstRow, rowCount;
+                FrameTiles::texelRange(planeRows[p], FrameTiles::rows, row, 1, &firstRow, &rowCount);
+                if (_tiles.containsRow(row)) {
+                    copyRows(firstRow, rowCount);
+                } else {
+                    int r = (firstRow + _fallbackRowStep - 1) / _fallbackRowStep * _fallbackRowStep;
+                    for (; r < firstRow + rowCount; r += _fallbackRowStep)
+                        copyRows(r, 1);
+                }
+            }
+        }
+        pboData[p] = reinterpret_cast<const void*>(offsets[p]);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    _pboRingUploads++;
+    *pboSlot = slot;
+    return pboData;
+}
+
+void FrameUploader::finishPboUpload(int pboSlot)
+{
+    if (pboSlot >= 0) {
+        // All texture uploads from this PBO are submitted; the fence tells us
+        // when the GPU is done reading so that the PBO can be reused.
+        _pboRingFences[pboSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+void FrameUploader::updateTexStorage(unsigned int* tex, TexStorage* storage,
+        unsigned int internalFormat, unsigned int format, unsigned int type,
+        int width, int height, int levels)
+{
+    if (storage->internalFormat == internalFormat
+            && storage->width == width && storage->height == height
+            && storage->levels == levels) {
+        glBindTexture(GL_TEXTURE_2D, *tex);
+        return;
+    }
+
+    LOG_DEBUG("reallocating texture storage: %dx%d, %d levels, internal format 0x%04X",
+            width, height, levels, internalFormat);
+    if (_haveTexStorage) {
+        // Immutable storage cannot be respecified, so we need a new texture
+        // object. It inherits the parameters of the old one.
+        GLint wrapS, wrapT, magFilter, minFilter;
+        GLfloat anisotropy = 1.0f;
+        glBindTexture(GL_TEXTURE_2D, *tex);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrapS);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrapT);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+        if (_haveAnisotropicFiltering)
+            glGetTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, &anisotropy);
+        _renderTargetPool->forgetTexture(*tex);
+        glDeleteTextures(1, tex);
+        glGenTextures(1, tex);
+        glBindTexture(GL_TEXTURE_2D, *tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+        if (_haveAnisotropicFiltering)
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, anisotropy);
+        glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+    } else {
+        // Mutable storage: allocate the base level; glGenerateMipmap() takes
+        // care of the other levels
+        glBindTexture(GL_TEXTURE_2D, *tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    }
+    storage->internalFormat = internalFormat;
+    storage->width = width;
+    storage->height = height;
+    storage->levels = levels;
+}
+
+void FrameUploader::setTiles(const FrameTiles& tiles)
+{
+    _tiles = tiles;
+}
+
+const FrameTiles& FrameUploader::tiles() const
+{
+    return _tiles;
+}
+
+void FrameUploader::uploadPlane(int plane, unsigned int internalFormat, unsigned int format, unsigned int type,
+        int width, int height, int bytesPerLine, const void* data)
+{
+    updateTexStorage(&(_planeTexs[plane]), &(_planeTexStorages[plane]), internalFormat, format, type, width, height, 1);
+
+    if (_tiles.isFull()) {
+        uploadTexels(plane, format, type, bytesPerLine, data, 0, 0, width, height, 1);
+        return;
+    }
+
+    // Upload each horizontal run of tiles in full resolution
+    for (int row = 0; row < FrameTiles::rows; row++) {
+        int column = 0;
+        while (column < FrameTiles::columns) {
+            if (!_tiles.contains(column, row)) {
+                column++;
+                continue;
+            }
+            int n = 1;
+            while (column + n < FrameTiles::columns && _tiles.contains(column + n, row))
+                n++;
+            int x, w, y, h;
+            FrameTiles::texelRange(width, FrameTiles::columns, column, n, &x, &w);
+            FrameTiles::texelRange(height, FrameTiles::rows, row, 1, &y, &h);
+            uploadTexels(plane, format, type, bytesPerLine, data, x, y, w, h, 1);
+            column += n;
+        }
+    }
+
+    // Upload every n-th row of the whole plane as the low resolution fallback
+    int fallbackHeight = (height + _fallbackRowStep - 1) / _fallbackRowStep;
+    updateTexStorage(&(_fallbackPlaneTexs[plane]), &(_fallbackPlaneTexStorages[plane]),
+            internalFormat, format, type, width, fallbackHeight, 1);
+    uploadTexels(plane, format, type, bytesPerLine, data, 0, 0, width, fallbackHeight, _fallbackRowStep);
+}
+
+void FrameUploader::uploadTexels(int plane, unsigned int format, unsigned int type, int bytesPerLine, const void* data,
+        int x, int y, int w, int h, int rowStep)
+{
+    // The texture is bound by updateTexStorage(). Texel row r of the texture
+    // is row r * rowStep of the plane data.
+    if (w == 0 || h == 0)
+        return;
+
+    // Upload padded rows directly by describing the row layout to OpenGL:
+    // the row length in pixels and the alignment of the row starts.
+    int bytesPerPixel = (format == GL_RED ? 1 : format == GL_RG ? 2 : 4) * (type == GL_UNSIGNED_SHORT ? 2 : 1);
+    int alignment = 8;
+    while (bytesPerLine % alignment != 0)
+        alignment /= 2;
+    int rowLength = bytesPerLine / bytesPerPixel;
+    ptrdiff_t stride = static_cast<ptrdiff_t>(rowStep) * bytesPerLine;
+    const unsigned char* texelData = static_cast<const unsigned char*>(data)
+        + y * stride + static_cast<ptrdiff_t>(x) * bytesPerPixel;
+    if (bytesPerLine % bytesPerPixel == 0 && rowLength >= x + w) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength * rowStep == w ? 0 : rowLength * rowStep);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, format, type, texelData);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else {
+        // The padding is not a multiple of the pixel size, so the row layout
+        // cannot be expressed via the unpack state. Upload row by row instead.
+        LOG_FIREHOSE("uploading plane %d row by row (%d bytes per line)", plane, bytesPerLine);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int r = 0; r < h; r++) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y + r, w, 1, format, type, texelData + r * stride);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void FrameUploader::uploadFrame(const VideoFrame& frame)
+{
+    // Get the frame data into plane textures, streaming it through the PBO ring
+    int w = frame.width;
+    int h = frame.height;
+    int planeFormat; // see shader-color-conversion.glsl
+    int planeCount;
+    int pboSlot;
+    // swizzling for plane0; might be changed below depending in the format
+    std::array<GLint, 4> swizzle = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    if (frame.storage == VideoFrame::Storage_Image) {
+        std::array<const void*, 3> planeData = copyPlanesToPbo(1,
+                { frame.image.constBits(), nullptr, nullptr },
+                { int(frame.image.sizeInBytes()), 0, 0 },
+                { int(frame.image.bytesPerLine()), 0, 0 },
+                { h, 0, 0 }, &pboSlot);
+        uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h, frame.image.bytesPerLine(), planeData[0]);
+        swizzle = { GL_BLUE, GL_GREEN, GL_RED, GL_ALPHA };
+        planeFormat = 1;
+        planeCount = 1;
+    } else {
+        std::array<const void*, 3> planeData;
+        if (frame.storage == VideoFrame::Storage_Mapped) {
+            planeData = { frame.mappedBits[0], frame.mappedBits[1], frame.mappedBits[2] };
+        } else {
+            planeData = { frame.bits[0].data(), frame.bits[1].data(), frame.bits[2].data() };
+        }
+        int planeRows[3], minBytesPerLine[3];
+        VideoFrame::planeLayout(frame.pixelFormat, w, h, planeRows, minBytesPerLine);
+        planeData = copyPlanesToPbo(frame.planeCount, planeData,
+                { frame.bytesPerPlane[0], frame.bytesPerPlane[1], frame.bytesPerPlane[2] },
+                { frame.bytesPerLine[0], frame.bytesPerLine[1], frame.bytesPerLine[2] },
+                { planeRows[0], planeRows[1], planeRows[2] }, &pboSlot);
+        if (frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_ARGB8888_Premultiplied
+                || frame.pixelFormat == QVideoFrameFormat::Format_XRGB8888) {
+            uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            swizzle = { GL_ALPHA, GL_RED, GL_GREEN, GL_BLUE };
+            planeFormat = 1;
+            planeCount = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_BGRA8888_Premultiplied
+                || frame.pixelFormat == QVideoFrameFormat::Format_BGRX8888) {
+            uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            swizzle = { GL_BLUE, GL_GREEN, GL_RED, GL_ALPHA };
+            planeFormat = 1;
+            planeCount = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_ABGR8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_XBGR8888) {
+            uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            swizzle = { GL_ALPHA, GL_BLUE, GL_GREEN, GL_RED };
+            planeFormat = 1;
+            planeCount = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_RGBA8888
+                || frame.pixelFormat == QVideoFrameFormat::Format_RGBX8888) {
+            uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            planeFormat = 1;
+            planeCount = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV420P) {
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            uploadPlane(2, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[2], planeData[2]);
+            planeFormat = 2;
+            planeCount = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV422P) {
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h, frame.bytesPerLine[1], planeData[1]);
+            uploadPlane(2, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h, frame.bytesPerLine[2], planeData[2]);
+            planeFormat = 2;
+            planeCount = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YV12) {
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            uploadPlane(2, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[2], planeData[2]);
+            planeFormat = 3;
+            planeCount = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_IMC1
+                || frame.pixelFormat == QVideoFrameFormat::Format_IMC3) {
+            // Like YV12 / YUV420P, but the chroma planes use the luma stride
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            uploadPlane(2, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[2], planeData[2]);
+            planeFormat = (frame.pixelFormat == QVideoFrameFormat::Format_IMC1 ? 3 : 2);
+            planeCount = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_IMC2
+                || frame.pixelFormat == QVideoFrameFormat::Format_IMC4) {
+            // One chroma plane with the luma stride; each of its lines holds
+            // the two chroma lines at half stride boundaries
+            const unsigned char* chroma = static_cast<const unsigned char*>(planeData[1]);
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], chroma);
+            uploadPlane(2, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], chroma + frame.bytesPerLine[1] / 2);
+            planeFormat = (frame.pixelFormat == QVideoFrameFormat::Format_IMC2 ? 3 : 2);
+            planeCount = 3;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_NV12) {
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_RG8, GL_RG, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            planeFormat = 4;
+            planeCount = 2;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_NV21) {
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_RG8, GL_RG, GL_UNSIGNED_BYTE, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            planeFormat = 6;
+            planeCount = 2;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUYV
+                || frame.pixelFormat == QVideoFrameFormat::Format_UYVY) {
+            uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w / 2, h, frame.bytesPerLine[0], planeData[0]);
+            planeFormat = (frame.pixelFormat == QVideoFrameFormat::Format_YUYV ? 7 : 8);
+            planeCount = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_AYUV
+                || frame.pixelFormat == QVideoFrameFormat::Format_AYUV_Premultiplied) {
+            uploadPlane(0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            planeFormat = 9;
+            planeCount = 1;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 4, 0)
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_YUV420P10) {
+            uploadPlane(0, GL_R16, GL_RED, GL_UNSIGNED_SHORT, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_R16, GL_RED, GL_UNSIGNED_SHORT, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            uploadPlane(2, GL_R16, GL_RED, GL_UNSIGNED_SHORT, w / 2, h / 2, frame.bytesPerLine[2], planeData[2]);
+            planeFormat = 10;
+            planeCount = 3;
+#endif
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_P010
+                || frame.pixelFormat == QVideoFrameFormat::Format_P016) {
+            uploadPlane(0, GL_R16, GL_RED, GL_UNSIGNED_SHORT, w, h, frame.bytesPerLine[0], planeData[0]);
+            uploadPlane(1, GL_RG16, GL_RG, GL_UNSIGNED_SHORT, w / 2, h / 2, frame.bytesPerLine[1], planeData[1]);
+            planeFormat = 4;
+            planeCount = 2;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y8) {
+            uploadPlane(0, GL_R8, GL_RED, GL_UNSIGNED_BYTE, w, h, frame.bytesPerLine[0], planeData[0]);
+            planeFormat = 5;
+            planeCount = 1;
+        } else if (frame.pixelFormat == QVideoFrameFormat::Format_Y16) {
+            uploadPlane(0, GL_R16, GL_RED, GL_UNSIGNED_SHORT, w, h, frame.bytesPerLine[0], planeData[0]);
+            planeFormat = 5;
+            planeCount = 1;
+        } else {
+            LOG_FATAL("Unhandled pixel format");
+            std::exit(1);
+        }
+    }
+    finishPboUpload(pboSlot);
+    for (int i = 0; i < (_tiles.isFull() ? 1 : 2); i++) {
+        glBindTexture(GL_TEXTURE_2D, i == 0 ? _planeTexs[0] : _fallbackPlaneTexs[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, swizzle[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, swizzle[1]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, swizzle[2]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, swizzle[3]);
+    }
+    _planeFormat = planeFormat;
+    _planeCount = planeCount;
+}
+
+void FrameUploader::convertPlanesToTexture(const VideoFrame& frame, unsigned int* frameTex, TexStorage* frameTexStorage)
+{
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+
+    // Convert plane textures into linear RGB in the frame texture
+    int w = frame.width;
+    int h = frame.height;
+    int frameTexLevels = 1;
+    for (int s = std::max(w, h); s > 1; s /= 2)
+        frameTexLevels++;
+    if (isGLES)
+        updateTexStorage(frameTex, frameTexStorage, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, w, h, frameTexLevels);
+    else
+        updateTexStorage(frameTex, frameTexStorage, GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, w, h, frameTexLevels);
+    glBindFramebuffer(GL_FRAMEBUFFER, _renderTargetPool->framebuffer(*frameTex, w, h, false));
+    glViewport(0, 0, w, h);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(colorPrg(_planeFormat, frame.yuvValueRangeSmall, frame.yuvSpace)->programId());
+    glBindVertexArray(_quadVao);
+    if (!_tiles.isFull()) {
+        // Convert the low resolution fallback everywhere, then overwrite the
+        // tiles that were uploaded in full resolution
+        for (int p = 0; p < _planeCount; p++) {
+            glActiveTexture(GL_TEXTURE0 + p);
+            glBindTexture(GL_TEXTURE_2D, _fallbackPlaneTexs[p]);
+        }
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    }
+    for (int p = 0; p < _planeCount; p++) {
+        glActiveTexture(GL_TEXTURE0 + p);
+        glBindTexture(GL_TEXTURE_2D, _planeTexs[p]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    if (_tiles.isFull()) {
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    } else {
+        glEnable(GL_SCISSOR_TEST);
+        for (int row = 0; row < FrameTiles::rows; row++) {
+            for (int column = 0; column < FrameTiles::columns; column++) {
+                if (!_tiles.contains(column, row))
+                    continue;
+                int n = 1;
+                while (column + n < FrameTiles::columns && _tiles.contains(column + n, row))
+                    n++;
+                int x, sw, y, sh;
+                FrameTiles::texelRange(w, FrameTiles::columns, column, n, &x, &sw);
+                FrameTiles::texelRange(h, FrameTiles::rows, row, 1, &y, &sh);
+                glScissor(x, y, sw, sh);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+                column += n - 1;
+            }
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
+    // Mipmaps are generated lazily by render(), only for the levels it needs
+    glBindTexture(GL_TEXTURE_2D, *frameTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    frameTexStorage->validLevels = 1;
+}
+
+void FrameUploader::convertFrameToTexture(const VideoFrame& frame, unsigned int* frameTex, TexStorage* frameTexStorage)
+{
+    uploadFrame(frame);
+    convertPlanesToTexture(frame, frameTex, frameTexStorage);
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include <QHash>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include "videoframe.hpp"
+#include "rendertargetpool.hpp"
+#include "frametiles.hpp"
+
+
+/* Gets video frames into OpenGL textures: the planes of a frame are copied
+ * into a pixel buffer object and uploaded from there into plane textures, and
+ * a color conversion pass turns them into a linear RGB frame texture. Each
+ * OpenGL context that uploads frames has its own instance.
+ *
+ * The PBO ring lets the transfer of a frame run while the next one is copied,
+ * with a fence guarding the reuse of each PBO. Streaming frame N+1 into a PBO
+ * while frame N is converted and drawn happens with the upload thread (see
+ * UploadThread), whose instance uploads in parallel to rendering. Without it,
+ * each frame is uploaded from the PBO it was just copied into and converted
+ * right after, since uploading one frame behind would display stale frames
+ * when paused or stepping. */
+class FrameUploader : protected QOpenGLExtraFunctions
+{
+public:
+    /* Current storage of a texture, so that we reallocate only when it changes */
+    struct TexStorage {
+        unsigned int internalFormat; // 0 means no storage yet
+        int width;
+        int height;
+        int levels;
+        int validLevels; // number of mipmap levels with current content
+    };
+
+private:
+    bool _haveAnisotropicFiltering;
+    bool _haveTexStorage;
+    RenderTargetPool* _renderTargetPool;
+    unsigned int _quadVao;
+    unsigned int _planeTexs[3];
+    TexStorage _planeTexStorages[3];
+    int _planeFormat; // plane format of the current plane texture contents
+    int _planeCount;
+    static const int _pboRingSize = 3;
+    unsigned int _pboRing[_pboRingSize]; // pixel buffer objects for plane uploads
+    GLsync _pboRingFences[_pboRingSize];
+    size_t _pboRingBufferSizes[_pboRingSize];
+    int _pboRingIndex;
+    unsigned long long _pboRingUploads; // number of uploads through the PBO ring
+    unsigned long long _pboRingStalls;  // number of uploads that had to wait for a PBO
+    QHash<int, QOpenGLShaderProgram*> _colorPrgs; // linked variants, see colorPrg()
+    FrameTiles _tiles; // tiles of the frame to upload and convert in full resolution
+    static const int _fallbackRowStep = 8; // the other tiles get every n-th row only
+    unsigned int _fallbackPlaneTexs[3];
+    TexStorage _fallbackPlaneTexStorages[3];
+
+    QOpenGLShaderProgram* colorPrg(int planeFormat, bool yuvValueRangeSmall, int yuvSpace);
+    std::array<const void*, 3> copyPlanesToPbo(int planeCount,
+            const std::array<const void*, 3>& planeData,
+            const std::array<int, 3>& planeSize,
+            const std::array<int, 3>& planeBytesPerLine,
+            const std::array<int, 3>& planeRows,
+            int* pboSlot);
+    void finishPboUpload(int pboSlot);
+    void uploadPlane(int plane, unsigned int internalFormat, unsigned int format, unsigned int type,
+            int width, int height, int bytesPerLine, const void* data);
+    void uploadTexels(int plane, unsigned int format, unsigned int type, int bytesPerLine, const void* data,
+            int x, int y, int w, int h, int rowStep);
+
+public:
+    FrameUploader();
+    ~FrameUploader();
+
+    // Initialize in the current OpenGL context. The conversion pass renders
+    // through framebuffer objects from the given render target pool.
+    void initialize(RenderTargetPool* renderTargetPool);
+
+    // The color conversion shader code for the given plane format
+    static QString colorConversionSource(int planeFormat, bool yuvValueRangeSmall, int yuvSpace);
+
+    // Create a frame texture without storage; the conversion allocates it
+    void createFrameTexture(unsigned int* frameTex, TexStorage* frameTexStorage);
+    // Reallocate the storage of a texture if its parameters changed, and bind it
+    void updateTexStorage(unsigned int* tex, TexStorage* storage,
+            unsigned int internalFormat, unsigned int format, unsigned int type,
+            int width, int height, int levels);
+
+    // Restrict full resolution uploads and conversions to a set of tiles of
+    // the frame. The other tiles get a low resolution version of the frame,
+    // which costs a fraction of a full upload. The default is all tiles.
+    void setTiles(const FrameTiles& tiles);
+    const FrameTiles& tiles() const;
+
+    // Upload the planes of the frame into the plane textures
+    void uploadFrame(const VideoFrame& frame);
+    // Convert the plane textures into the frame texture (only its base level)
+    void convertPlanesToTexture(const VideoFrame& frame, unsigned int* frameTex, TexStorage* frameTexStorage);
+    // Both of the above
+    void convertFrameToTexture(const VideoFrame& frame, unsigned int* frameTex, TexStorage* frameTexStorage);
+
+    // The plane textures and their format, see shader-color-conversion.glsl
+    unsigned int planeTex(int plane) const;
+    int planeFormat() const;
+    int planeCount() const;
+};
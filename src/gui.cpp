@@ -56,9 +56,9 @@ void Gui::addBinoAction(QAction* action, QMenu* menu)
 
 static Gui* GuiSingleton = nullptr;
 
-Gui::Gui(OutputMode outputMode, bool fullscreen) :
+Gui::Gui(OutputMode outputMode, bool fullscreen, bool renderThread) :
     QMainWindow(),
-    _widget(new Widget(outputMode, this)),
+    _widget(new Widget(outputMode, renderThread, this)),
     _contextMenu(new QMenu(this))
 {
     setWindowTitle("Bino");
@@ -140,11 +140,26 @@ Gui::Gui(OutputMode outputMode, bool fullscreen) :
     _3dSurroundActionGroup->addAction(threeDSurround180)->setData(int(Surround_180));
     connect(threeDSurround180, SIGNAL(triggered()), this, SLOT(threeDSurround()));
     addBinoAction(threeDSurround180, threeDMenu);
+    QAction* threeDSurround180Fisheye = new QAction(surroundModeToStringUI(Surround_180_Fisheye), this);
+    threeDSurround180Fisheye->setCheckable(true);
+    _3dSurroundActionGroup->addAction(threeDSurround180Fisheye)->setData(int(Surround_180_Fisheye));
+    connect(threeDSurround180Fisheye, SIGNAL(triggered()), this, SLOT(threeDSurround()));
+    addBinoAction(threeDSurround180Fisheye, threeDMenu);
     QAction* threeDSurround360 = new QAction(surroundModeToStringUI(Surround_360), this);
     threeDSurround360->setCheckable(true);
     _3dSurroundActionGroup->addAction(threeDSurround360)->setData(int(Surround_360));
     connect(threeDSurround360, SIGNAL(triggered()), this, SLOT(threeDSurround()));
     addBinoAction(threeDSurround360, threeDMenu);
+    QAction* threeDSurround360EAC = new QAction(surroundModeToStringUI(Surround_360_EAC), this);
+    threeDSurround360EAC->setCheckable(true);
+    _3dSurroundActionGroup->addAction(threeDSurround360EAC)->setData(int(Surround_360_EAC));
+    connect(threeDSurround360EAC, SIGNAL(triggered()), this, SLOT(threeDSurround()));
+    addBinoAction(threeDSurround360EAC, threeDMenu);
+    QAction* threeDSurround360Cubemap = new QAction(surroundModeToStringUI(Surround_360_Cubemap), this);
+    threeDSurround360Cubemap->setCheckable(true);
+    _3dSurroundActionGroup->addAction(threeDSurround360Cubemap)->setData(int(Surround_360_Cubemap));
+    connect(threeDSurround360Cubemap, SIGNAL(triggered()), this, SLOT(threeDSurround()));
+    addBinoAction(threeDSurround360Cubemap, threeDMenu);
     threeDMenu->addSeparator();
     _3dInputActionGroup = new QActionGroup(this);
     QAction* threeDInMono = new QAction(tr("Input 2D"), this);
@@ -639,7 +654,7 @@ void Gui::threeDSurround()
     QAction* a = _3dSurroundActionGroup->checkedAction();
     if (a) {
         Bino::instance()->setSurroundMode(static_cast<SurroundMode>(a->data().toInt()));
-        _widget->update();
+        _widget->updateViews();
     }
 }
 
@@ -648,7 +663,7 @@ void Gui::threeDInput()
     QAction* a = _3dInputActionGroup->checkedAction();
     if (a) {
         Bino::instance()->setInputMode(static_cast<InputMode>(a->data().toInt()));
-        _widget->update();
+        _widget->updateViews();
     }
 }
 
@@ -737,7 +752,7 @@ void Gui::viewToggleFullscreen()
 void Gui::viewToggleSwapEyes()
 {
     Bino::instance()->toggleSwapEyes();
-    _widget->update();
+    _widget->updateViews();
 }
 
 void Gui::helpAbout()
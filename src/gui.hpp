@@ -105,7 +105,7 @@ protected:
     virtual void moveEvent(QMoveEvent*) override;
 
 public:
-    Gui(OutputMode outputMode, bool fullscreen);
+    Gui(OutputMode outputMode, bool fullscreen, bool renderThread);
 
     static Gui* instance();
 
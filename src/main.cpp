@@ -129,6 +129,10 @@ int main(int argc, char* argv[])
             QCommandLineParser::tr("Use OpenGL ES instead of Desktop OpenGL.") });
     parser.addOption({ "stereo",
             QCommandLineParser::tr("Use OpenGL quad-buffered stereo in GUI mode.")});
+    parser.addOption({ "render-thread",
+            QCommandLineParser::tr("Render video in a separate thread in GUI mode.")});
+    parser.addOption({ "upload-thread",
+            QCommandLineParser::tr("Upload video frames in a separate thread in GUI mode.")});
     parser.addOption({ "vr",
             QCommandLineParser::tr("Start in VR mode instead of GUI mode.")});
     parser.addOption({ "vr-screen",
@@ -136,6 +140,17 @@ int main(int argc, char* argv[])
             "nine values representing three 3D coordinates that define a planar screen (bottom left, bottom right, top left) "
             "or as a name of an OBJ file that contains the screen geometry with texture coordinates."),
             "screen" });
+    parser.addOption({ "vr-shared-memory",
+            QCommandLineParser::tr("Transfer video frames to VR child processes via shared memory. "
+            "All processes must run on the same host.")});
+    parser.addOption({ "vr-frame-compression",
+            QCommandLineParser::tr("Compress video frames for VR child processes on other hosts "
+            "(fast, delta)."), "method" });
+    parser.addOption({ "vr-local-decoding",
+            QCommandLineParser::tr("Let each VR process decode the media itself, synchronized to the main process.")});
+    parser.addOption({ { "region-upload", "vr-region-upload" },
+            QCommandLineParser::tr("Upload only the tiles of a video frame that are displayed, "
+            "and a low resolution version of the rest.")});
     parser.addOption({ "capture",
             QCommandLineParser::tr("Capture video/audio input from camera and microphone.") });
     parser.addOption({ "list-audio-outputs",
@@ -192,8 +207,11 @@ int main(int argc, char* argv[])
             "red-green-monochrome, red-blue-monochrome"),
             "mode" });
     parser.addOption({ "surround",
-            QCommandLineParser::tr("Set surround mode (%1).").arg("360, 180, off"),
+            QCommandLineParser::tr("Set surround mode (%1).").arg("360, 360-eac, 360-cubemap, 180, 180-fisheye, off"),
             "mode" });
+    parser.addOption({ "fisheye-fov",
+            QCommandLineParser::tr("Set the lens field of view of fisheye surround video in degrees (default 180)."),
+            "degrees" });
     parser.addOption({ { "S", "swap-eyes" },
             QCommandLineParser::tr("Swap left/right eye.") });
     parser.addOption({ { "f", "fullscreen" },
@@ -240,6 +258,15 @@ int main(int argc, char* argv[])
             return 1;
         }
     }
+    float fisheyeFieldOfView = 180.0f;
+    if (parser.isSet("fisheye-fov")) {
+        bool ok;
+        fisheyeFieldOfView = parser.value("fisheye-fov").toFloat(&ok);
+        if (!ok || fisheyeFieldOfView <= 0.0f || fisheyeFieldOfView > 360.0f) {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--fisheye-fov")));
+            return 1;
+        }
+    }
     InputMode inputMode = Input_Unknown;
     if (parser.isSet("input")) {
         bool ok;
@@ -541,6 +568,21 @@ int main(int argc, char* argv[])
     bool vrMainProcess = parser.isSet("vr");
     bool vrMode = (vrMainProcess || vrChildProcess);
     bool guiMode = !vrMode;
+    if (vrMode && parser.isSet("vr-local-decoding") && parser.isSet("capture")) {
+        LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Cannot use %1 in capture mode").arg("--vr-local-decoding")));
+        return 1;
+    }
+    FrameCodec::Method vrFrameCompression = FrameCodec::Method_None;
+    if (vrMode && parser.isSet("vr-frame-compression")) {
+        if (parser.value("vr-frame-compression") == "fast") {
+            vrFrameCompression = FrameCodec::Method_Compress;
+        } else if (parser.value("vr-frame-compression") == "delta") {
+            vrFrameCompression = FrameCodec::Method_Delta;
+        } else {
+            LOG_FATAL("%s", qPrintable(QCommandLineParser::tr("Invalid argument for option %1").arg("--vr-frame-compression")));
+            return 1;
+        }
+    }
 
     // Set the OpenGL context parameters
     QSurfaceFormat format;
@@ -574,7 +616,10 @@ int main(int argc, char* argv[])
     QSurfaceFormat::setDefaultFormat(format);
 
     // Initialize Bino (in VR mode: only from the main process!)
-    Bino bino(screen, parser.isSet("swap-eyes"));
+    Bino bino(screen, parser.isSet("swap-eyes"), guiMode && parser.isSet("upload-thread"),
+            vrMode && parser.isSet("vr-shared-memory"), vrFrameCompression,
+            vrMode && parser.isSet("vr-local-decoding"),
+            parser.isSet("region-upload"), fisheyeFieldOfView);
     if (guiMode || !vrChildProcess) {
         bino.initializeOutput(audioOutputDeviceIndex >= 0
                 ? audioOutputDevices[audioOutputDeviceIndex]
@@ -607,7 +652,7 @@ int main(int argc, char* argv[])
         return 1;
 #endif
     } else {
-        Gui gui(outputMode, parser.isSet("fullscreen"));
+        Gui gui(outputMode, parser.isSet("fullscreen"), parser.isSet("render-thread"));
         gui.show();
         // wait for several seconds to process all events before starting
         // the playlist, because otherwise playing might be finished before
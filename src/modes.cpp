@@ -157,6 +157,15 @@ const char* surroundModeToString(SurroundMode mode)
     case Surround_360:
         return "360";
         break;
+    case Surround_360_EAC:
+        return "360-eac";
+        break;
+    case Surround_360_Cubemap:
+        return "360-cubemap";
+        break;
+    case Surround_180_Fisheye:
+        return "180-fisheye";
+        break;
     }
     return nullptr;
 }
@@ -176,6 +185,15 @@ QString surroundModeToStringUI(SurroundMode mode)
     case Surround_360:
         return QCoreApplication::translate("Mode", "Surround 360°");
         break;
+    case Surround_360_EAC:
+        return QCoreApplication::translate("Mode", "Surround 360° equi-angular cube map");
+        break;
+    case Surround_360_Cubemap:
+        return QCoreApplication::translate("Mode", "Surround 360° cube map");
+        break;
+    case Surround_180_Fisheye:
+        return QCoreApplication::translate("Mode", "Surround 180° fisheye");
+        break;
     }
     return QString();
 }
@@ -190,6 +208,12 @@ SurroundMode surroundModeFromString(const QString& s, bool* ok)
         mode = Surround_180;
     else if (s == "360")
         mode = Surround_360;
+    else if (s == "360-eac")
+        mode = Surround_360_EAC;
+    else if (s == "360-cubemap")
+        mode = Surround_360_Cubemap;
+    else if (s == "180-fisheye")
+        mode = Surround_180_Fisheye;
     else
         r = false;
     if (ok)
@@ -45,11 +45,15 @@ QString inputModeToStringUI(InputMode mode);
 InputMode inputModeFromString(const QString& s, bool* ok = nullptr);
 
 /* Surround mode (180° / 360°) */
+// Note that the playlist editor lists the modes up to Surround_180_Fisheye!
 enum SurroundMode {
     Surround_Unknown = 0,     // unknown; needs to be guessed
     Surround_Off = 1,         // conventional video
     Surround_180 = 2,         // 180° video
     Surround_360 = 3,         // 360° video
+    Surround_360_EAC = 4,     // 360° video, equi-angular cube map (3x2 layout)
+    Surround_360_Cubemap = 5, // 360° video, cube map (3x2 layout)
+    Surround_180_Fisheye = 6, // 180° video, equidistant fisheye
 };
 
 const char* surroundModeToString(SurroundMode mode);
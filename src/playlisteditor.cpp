@@ -18,6 +18,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include <QGridLayout>
 #include <QSpacerItem>
 #include <QPushButton>
@@ -66,8 +68,12 @@ PlaylistEntryEditor::PlaylistEntryEditor(const PlaylistEntry& entry, QWidget* pa
     QLabel* surroundModeLabel = new QLabel(tr("Surround Mode:"));
     layout->addWidget(surroundModeLabel, 3, 0);
     surroundModeBox = new QComboBox(this);
-    for (int i = 0; i < 4; i++)
+    // The combobox index is the SurroundMode value, so all modes must be listed
+    for (int i = 0; i <= Surround_180_Fisheye; i++) {
+        Q_ASSERT(surroundModeToString(static_cast<SurroundMode>(i)));
         surroundModeBox->addItem(surroundModeToStringUI(static_cast<SurroundMode>(i)));
+    }
+    Q_ASSERT(!surroundModeToString(static_cast<SurroundMode>(Surround_180_Fisheye + 1)));
     connect(surroundModeBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateEntry()));
     layout->addWidget(surroundModeBox, 3, 1, 1, 2);
 
@@ -144,7 +150,7 @@ void PlaylistEntryEditor::setURL()
 void PlaylistEntryEditor::updateEntry()
 {
     entry.inputMode = static_cast<InputMode>(inputModeBox->currentIndex());
-    entry.surroundMode = static_cast<SurroundMode>(surroundModeBox->currentIndex());
+    entry.surroundMode = static_cast<SurroundMode>(std::max(surroundModeBox->currentIndex(), 0));
     entry.videoTrack = videoTrackBox->currentIndex() >= 0 ? videoTrackBox->currentIndex() - 1 : -1;
     entry.audioTrack = audioTrackBox->currentIndex() >= 0 ? audioTrackBox->currentIndex() - 1 : -1;
     entry.subtitleTrack = subtitleTrackBox->currentIndex() >= 0 ? subtitleTrackBox->currentIndex() - 2 : -2;
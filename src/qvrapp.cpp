@@ -111,6 +111,13 @@ bool BinoQVRApp::wantExit()
     return Bino::instance()->wantExit();
 }
 
+void BinoQVRApp::update(const QList<QVRObserver*>&)
+{
+    // This runs only on the master process, before the dynamic data is
+    // serialized, so all processes show the same frame.
+    Bino::instance()->selectFrame();
+}
+
 bool BinoQVRApp::initProcess(QVRProcess*)
 {
     initializeOpenGLFunctions();
@@ -127,8 +134,8 @@ bool BinoQVRApp::initProcess(QVRProcess*)
         vrdeviceVS.prepend("#version 330\n");
         vrdeviceFS.prepend("#version 330\n");
     }
-    _prg.addShaderFromSourceCode(QOpenGLShader::Vertex, vrdeviceVS);
-    _prg.addShaderFromSourceCode(QOpenGLShader::Fragment, vrdeviceFS);
+    _prg.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vrdeviceVS);
+    _prg.addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, vrdeviceFS);
     _prg.link();
     // Get device model data
     for (int i = 0; i < QVRManager::deviceModelVertexDataCount(); i++) {
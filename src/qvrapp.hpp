@@ -57,6 +57,8 @@ public:
 
     bool wantExit() override;
 
+    void update(const QList<QVRObserver*>& observers) override;
+
     bool initProcess(QVRProcess* p) override;
 
     void preRenderProcess(QVRProcess* p) override;
@@ -0,0 +1,173 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rendertargetpool.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+RenderTargetPool::RenderTargetPool() :
+    _haveAnisotropicFiltering(false)
+{
+}
+
+void RenderTargetPool::initialize()
+{
+    initializeOpenGLFunctions();
+    _haveAnisotropicFiltering = checkTextureAnisotropicFilterAvailability();
+}
+
+unsigned int RenderTargetPool::texture(int slot, int width, int height, int layers,
+        unsigned int internalFormat, unsigned int format, unsigned int type)
+{
+    auto it = _slotTextures.find(slot);
+    if (it != _slotTextures.end()) {
+        if (it->width == width && it->height == height && it->layers == layers && it->internalFormat == internalFormat)
+            return it->tex;
+        releaseTexture(*it);
+        _slotTextures.erase(it);
+    }
+
+    // Reuse a free texture with matching storage if possible
+    for (int i = 0; i < _freeTextures.size(); i++) {
+        const Texture& t = _freeTextures[i];
+        if (t.width == width && t.height == height && t.layers == layers && t.internalFormat == internalFormat) {
+            Texture texture = _freeTextures.takeAt(i);
+            LOG_FIREHOSE("render target pool: reusing %dx%dx%d texture for slot %d", width, height, layers, slot);
+            _slotTextures.insert(slot, texture);
+            return texture.tex;
+        }
+    }
+
+    LOG_DEBUG("render target pool: allocating %dx%dx%d texture for slot %d", width, height, layers, slot);
+    Texture texture = { 0, width, height, layers, internalFormat };
+    glGenTextures(1, &texture.tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture.tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, layers, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    if (_haveAnisotropicFiltering)
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
+    _slotTextures.insert(slot, texture);
+    return texture.tex;
+}
+
+void RenderTargetPool::releaseTexture(const Texture& texture)
+{
+    _freeTextures.append(texture);
+    if (_freeTextures.size() > _maxFreeTextures) {
+        Texture oldest = _freeTextures.takeFirst();
+        LOG_DEBUG("render target pool: deleting %dx%dx%d texture", oldest.width, oldest.height, oldest.layers);
+        forgetTexture(oldest.tex);
+        glDeleteTextures(1, &oldest.tex);
+    }
+}
+
+unsigned int RenderTargetPool::depthBuffer(int width, int height)
+{
+    quint64 key = (quint64(width) << 32) | quint64(height);
+    unsigned int rb = _depthBuffers.value(key, 0);
+    if (rb == 0) {
+        LOG_DEBUG("render target pool: allocating %dx%d depth buffer", width, height);
+        glGenRenderbuffers(1, &rb);
+        glBindRenderbuffer(GL_RENDERBUFFER, rb);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        _depthBuffers.insert(key, rb);
+    }
+    return rb;
+}
+
+unsigned int RenderTargetPool::framebuffer(unsigned int colorTex, int width, int height, bool depth)
+{
+    return framebuffer(colorTex, NoLayer, width, height, depth);
+}
+
+unsigned int RenderTargetPool::framebuffer(unsigned int colorTex, int layer, int width, int height, bool depth)
+{
+    if (layer == AllLayers)
+        depth = false;
+    quint64 key = (quint64(colorTex) << 32) | quint32(layer);
+    auto it = _framebuffers.find(key);
+    if (it != _framebuffers.end() && it->width == width && it->height == height && it->depth == depth)
+        return it->fbo;
+
+    Framebuffer fb;
+    bool reattach = (it != _framebuffers.end());
+    Framebuffer oldFb = (reattach ? *it : Framebuffer { 0, colorTex, layer, 0, 0, false });
+    if (reattach) {
+        // The texture was respecified with a different size; reattach
+        fb = oldFb;
+    } else {
+        glGenFramebuffers(1, &fb.fbo);
+    }
+    fb.colorTex = colorTex;
+    fb.layer = layer;
+    fb.width = width;
+    fb.height = height;
+    fb.depth = depth;
+    glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
+    if (layer == NoLayer)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+    else if (layer == AllLayers)
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTex, 0);
+    else
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTex, 0, layer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+            depth ? depthBuffer(width, height) : 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        LOG_WARNING("render target pool: incomplete %dx%d framebuffer (status 0x%04X)", width, height, status);
+    _framebuffers.insert(key, fb);
+    if (reattach && oldFb.depth)
+        releaseDepthBuffer(oldFb.width, oldFb.height);
+    return fb.fbo;
+}
+
+void RenderTargetPool::releaseDepthBuffer(int width, int height)
+{
+    for (auto it = _framebuffers.cbegin(); it != _framebuffers.cend(); ++it) {
+        if (it->depth && it->width == width && it->height == height)
+            return; // still in use
+    }
+    quint64 key = (quint64(width) << 32) | quint64(height);
+    unsigned int rb = _depthBuffers.take(key);
+    if (rb != 0) {
+        LOG_DEBUG("render target pool: deleting %dx%d depth buffer", width, height);
+        glDeleteRenderbuffers(1, &rb);
+    }
+}
+
+void RenderTargetPool::forgetTexture(unsigned int colorTex)
+{
+    for (auto it = _framebuffers.begin(); it != _framebuffers.end(); ) {
+        if (it->colorTex != colorTex) {
+            ++it;
+            continue;
+        }
+        Framebuffer fb = *it;
+        glDeleteFramebuffers(1, &fb.fbo);
+        it = _framebuffers.erase(it);
+        if (fb.depth)
+            releaseDepthBuffer(fb.width, fb.height);
+    }
+}
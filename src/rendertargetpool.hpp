@@ -0,0 +1,92 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QOpenGLExtraFunctions>
+
+
+/* A pool of render targets: color array textures, depth buffers, and framebuffer
+ * objects that combine them. Everything is allocated once per size and format
+ * and then recycled across frames, so that rendering does not reallocate
+ * GPU memory. All functions must be called with the OpenGL context current
+ * that was current when initialize() was called. */
+class RenderTargetPool : protected QOpenGLExtraFunctions
+{
+private:
+    struct Texture {
+        unsigned int tex;
+        int width;
+        int height;
+        int layers;
+        unsigned int internalFormat;
+    };
+    struct Framebuffer {
+        unsigned int fbo;
+        unsigned int colorTex;
+        int layer;
+        int width;
+        int height;
+        bool depth;
+    };
+
+    static const int _maxFreeTextures = 4;
+
+    bool _haveAnisotropicFiltering;
+    QHash<int, Texture> _slotTextures;              // textures currently handed out, by slot
+    QList<Texture> _freeTextures;                   // textures waiting for reuse
+    QHash<quint64, unsigned int> _depthBuffers;     // depth renderbuffers, by size
+    QHash<quint64, Framebuffer> _framebuffers;      // framebuffer objects, by color texture and layer
+
+    unsigned int depthBuffer(int width, int height);
+    void releaseDepthBuffer(int width, int height);
+    void releaseTexture(const Texture& texture);
+
+public:
+    static const int NoLayer = -1;   // the color texture is a plain 2D texture
+    static const int AllLayers = -2; // layered rendering into all layers of an array texture
+
+    RenderTargetPool();
+
+    void initialize();
+
+    // Return the 2D array color texture for the given slot, with storage of
+    // the given size, number of layers, and format. The texture stays the same
+    // as long as these parameters do not change. Its content is undefined
+    // after a change.
+    unsigned int texture(int slot, int width, int height, int layers,
+            unsigned int internalFormat, unsigned int format, unsigned int type);
+
+    // Return a complete framebuffer object that renders into the given 2D color
+    // texture, optionally with a depth buffer. It is created on first use.
+    unsigned int framebuffer(unsigned int colorTex, int width, int height, bool depth);
+
+    // Return a complete framebuffer object that renders into one layer of the
+    // given 2D array color texture, or into all of its layers if the layer is
+    // AllLayers. Depth buffers cannot be layered, so they are only available
+    // for single layers. It is created on first use.
+    unsigned int framebuffer(unsigned int colorTex, int layer, int width, int height, bool depth);
+
+    // Forget the framebuffer objects that render into the given color texture.
+    // This must be called before the texture is deleted.
+    void forgetTexture(unsigned int colorTex);
+};
@@ -0,0 +1,141 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <utility>
+
+#include "renderthread.hpp"
+#include "bino.hpp"
+#include "log.hpp"
+
+
+RenderThread::RenderThread(QOpenGLContext* shareContext) :
+    _quit(false),
+    _haveRequest(false),
+    _renderIndex(0),
+    _readyIndex(1),
+    _displayIndex(2),
+    _haveReadyViews(false)
+{
+    for (int i = 0; i < 3; i++)
+        _views[i] = { 0, false, Output_Left, 1.0f, 1.0f, false, 0.0f, 0.0f, nullptr, nullptr };
+    _context = new QOpenGLContext;
+    _context->setFormat(shareContext->format());
+    _context->setShareContext(shareContext);
+    if (!_context->create())
+        LOG_FATAL("cannot create OpenGL context for the render thread");
+    _surface = new QOffscreenSurface;
+    _surface->setFormat(_context->format());
+    _surface->create();
+    _context->moveToThread(this);
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+    delete _context;
+    delete _surface;
+}
+
+void RenderThread::stop()
+{
+    _mutex.lock();
+    _quit = true;
+    _wakeup.wakeOne();
+    _mutex.unlock();
+    wait();
+}
+
+void RenderThread::requestViews(const ViewRenderer::Parameters& parameters)
+{
+    _mutex.lock();
+    _request = parameters;
+    _haveRequest = true;
+    _wakeup.wakeOne();
+    _mutex.unlock();
+}
+
+ViewRenderer::Views* RenderThread::displayViews()
+{
+    QMutexLocker locker(&_mutex);
+    if (_haveReadyViews) {
+        std::swap(_displayIndex, _readyIndex);
+        _haveReadyViews = false;
+    }
+    ViewRenderer::Views* views = &(_views[_displayIndex]);
+    return (views->viewTex == 0 ? nullptr : views);
+}
+
+void RenderThread::run()
+{
+    _context->makeCurrent(_surface);
+    initializeOpenGLFunctions();
+    Bino::instance()->initProcess();
+    _viewRenderer.initialize();
+    LOG_DEBUG("render thread started");
+
+    for (;;) {
+        ViewRenderer::Parameters parameters;
+        _mutex.lock();
+        while (!_quit && !_haveRequest)
+            _wakeup.wait(&_mutex);
+        bool quit = _quit;
+        parameters = _request;
+        _haveRequest = false;
+        ViewRenderer::Views* views = &(_views[_renderIndex]);
+        _mutex.unlock();
+        if (quit)
+            break;
+
+        // Do not overwrite the views before the widget has finished displaying
+        // them, and discard views that were never displayed
+        if (views->displayFence) {
+            glWaitSync(views->displayFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(views->displayFence);
+            views->displayFence = nullptr;
+        }
+        if (views->renderFence) {
+            glDeleteSync(views->renderFence);
+            views->renderFence = nullptr;
+        }
+
+        bool framesPending;
+        Bino::instance()->renderMutex()->lock();
+        framesPending = Bino::instance()->selectFrameAt(parameters.frameSelectionTime);
+        _viewRenderer.render(parameters, _renderIndex, views);
+        Bino::instance()->renderMutex()->unlock();
+        views->renderFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        _mutex.lock();
+        std::swap(_renderIndex, _readyIndex);
+        _haveReadyViews = true;
+        _mutex.unlock();
+        emit viewsReady(framesPending);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (_views[i].renderFence)
+            glDeleteSync(_views[i].renderFence);
+        if (_views[i].displayFence)
+            glDeleteSync(_views[i].displayFence);
+    }
+    _context->doneCurrent();
+    LOG_DEBUG("render thread finished");
+}
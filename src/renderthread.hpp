@@ -0,0 +1,86 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLExtraFunctions>
+
+#include "viewrenderer.hpp"
+
+
+/* A thread that owns an OpenGL context shared with the widget and does all
+ * the work of preparing the views: frame selection, upload, color conversion
+ * and view rendering. The widget only puts the finished views on screen, so
+ * that a busy GUI thread does not stall video output and vice versa.
+ *
+ * The views are triple buffered: the render thread renders into one buffer
+ * while the widget displays another, and the third holds the newest finished
+ * views. OpenGL sync objects order the accesses of both contexts. */
+class RenderThread : public QThread, protected QOpenGLExtraFunctions
+{
+Q_OBJECT
+
+private:
+    QOpenGLContext* _context;
+    QOffscreenSurface* _surface;
+    ViewRenderer _viewRenderer;
+
+    QMutex _mutex;            // protects the following members
+    QWaitCondition _wakeup;
+    bool _quit;
+    bool _haveRequest;
+    ViewRenderer::Parameters _request;
+    ViewRenderer::Views _views[3];
+    int _renderIndex;         // buffer owned by the render thread
+    int _readyIndex;          // buffer with the newest finished views
+    int _displayIndex;        // buffer owned by the widget
+    bool _haveReadyViews;
+
+protected:
+    void run() override;
+
+public:
+    // Create the shared context; this must be called on the GUI thread
+    // with the widget's context current.
+    RenderThread(QOpenGLContext* shareContext);
+    virtual ~RenderThread();
+
+    // Request new views with the given parameters. Requests that arrive while
+    // the thread is busy replace each other, so only the newest one is done.
+    void requestViews(const ViewRenderer::Parameters& parameters);
+
+    // Stop the thread and wait for it to finish.
+    void stop();
+
+    // Widget side: return the views to display. If newer views are finished,
+    // they replace the previously displayed ones. Returns nullptr if no views
+    // were finished yet. The returned views stay valid until the next call.
+    ViewRenderer::Views* displayViews();
+
+signals:
+    // Emitted when new views are finished. If framesPending is set, queued
+    // frames were not due yet and new views should be requested later.
+    void viewsReady(bool framesPending);
+};
@@ -0,0 +1,170 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <QVector2D>
+#include <QVector4D>
+
+#include "screenregion.hpp"
+
+
+namespace {
+
+struct ClipVertex {
+    QVector4D position; // in clip space
+    QVector2D texcoord;
+};
+
+// Distance of a clip space position to one of the six frustum planes;
+// it is inside if the distance is not negative
+float planeDistance(const QVector4D& p, int plane)
+{
+    switch (plane) {
+    case 0: return p.w() + p.x();
+    case 1: return p.w() - p.x();
+    case 2: return p.w() + p.y();
+    case 3: return p.w() - p.y();
+    case 4: return p.w() + p.z();
+    default: return p.w() - p.z();
+    }
+}
+
+// Sutherland-Hodgman clipping of a convex polygon against one plane
+void clipPolygon(QList<ClipVertex>& polygon, int plane)
+{
+    QList<ClipVertex> result;
+    for (int i = 0; i < polygon.size(); i++) {
+        const ClipVertex& a = polygon[i];
+        const ClipVertex& b = polygon[(i + 1) % polygon.size()];
+        float da = planeDistance(a.position, plane);
+        float db = planeDistance(b.position, plane);
+        if (da >= 0.0f)
+            result.append(a);
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            float t = da / (da - db);
+            result.append({ a.position + t * (b.position - a.position),
+                    a.texcoord + t * (b.texcoord - a.texcoord) });
+        }
+    }
+    polygon = result;
+}
+
+}
+
+QRectF visibleScreenRegion(const Screen& screen, const QMatrix4x4& projectionModelViewMatrix)
+{
+    float minU = 1.0f, maxU = 0.0f, minV = 1.0f, maxV = 0.0f;
+    QList<ClipVertex> polygon;
+    for (int i = 0; i + 2 < screen.indices.size(); i += 3) {
+        polygon.clear();
+        for (int j = 0; j < 3; j++) {
+            unsigned int index = screen.indices[i + j];
+            polygon.append({
+                    projectionModelViewMatrix * QVector4D(screen.positions[3 * index + 0],
+                            screen.positions[3 * index + 1], screen.positions[3 * index + 2], 1.0f),
+                    QVector2D(screen.texcoords[2 * index + 0], screen.texcoords[2 * index + 1]) });
+        }
+        for (int plane = 0; plane < 6 && polygon.size() > 0; plane++)
+            clipPolygon(polygon, plane);
+        for (int j = 0; j < polygon.size(); j++) {
+            minU = std::min(minU, polygon[j].texcoord.x());
+            maxU = std::max(maxU, polygon[j].texcoord.x());
+            minV = std::min(minV, polygon[j].texcoord.y());
+            maxV = std::max(maxV, polygon[j].texcoord.y());
+        }
+    }
+    if (minU > maxU || minV > maxV)
+        return QRectF();
+    return QRectF(minU, minV, maxU - minU, maxV - minV);
+}
+
+QRectF visibleSurroundRegion(const QMatrix4x4& projectionMatrix, const QMatrix4x4& orientationMatrix,
+        int surroundDegrees)
+{
+    const float pi = 3.14159265358979323846f;
+    const float uScale = (surroundDegrees == 360 ? 2.0f * pi : pi);
+
+    // Check if one of the poles is visible: then all longitudes are visible
+    bool poleVisible[2];
+    for (int i = 0; i < 2; i++) {
+        // the shader uses position * orientationMatrix, so directions
+        // are transformed back with the matrix itself
+        QVector4D pole = orientationMatrix * QVector4D(0.0f, i == 0 ? -1.0f : +1.0f, 0.0f, 0.0f);
+        QVector4D p = projectionMatrix * pole;
+        poleVisible[i] = (p.w() > 0.0f && std::abs(p.x()) <= p.w() && std::abs(p.y()) <= p.w());
+    }
+
+    // Sample view directions on a grid over the frustum
+    const int n = 16;
+    QMatrix4x4 inverseProjection = projectionMatrix.inverted();
+    QMatrix4x4 inverseOrientation = orientationMatrix.transposed();
+    QList<float> us;
+    float minV = 1.0f, maxV = 0.0f;
+    for (int y = 0; y <= n; y++) {
+        for (int x = 0; x <= n; x++) {
+            QVector4D eye = inverseProjection * QVector4D(2.0f * x / n - 1.0f, 2.0f * y / n - 1.0f, -1.0f, 1.0f);
+            QVector3D dir = (inverseOrientation * QVector4D(eye.toVector3D() / eye.w(), 0.0f)).toVector3D().normalized();
+            float theta = std::asin(std::clamp(-dir.y(), -1.0f, 1.0f));
+            float phi = std::atan2(dir.x(), -dir.z());
+            us.append(phi / uScale + 0.5f);
+            float v = theta / pi + 0.5f;
+            minV = std::min(minV, v);
+            maxV = std::max(maxV, v);
+        }
+    }
+    // theta = asin(-y): the pole with negative y is at v = 1
+    if (poleVisible[0])
+        maxV = 1.0f;
+    if (poleVisible[1])
+        minV = 0.0f;
+    if (poleVisible[0] || poleVisible[1])
+        return QRectF(0.0f, minV, 1.0f, maxV - minV);
+
+    float minU, maxU;
+    std::sort(us.begin(), us.end());
+    if (surroundDegrees == 360) {
+        // The visible longitudes are the complement of the largest gap between
+        // samples on the circle.
+        int gapEnd = 0;
+        float gap = us.first() + 1.0f - us.last();
+        for (int i = 1; i < us.size(); i++) {
+            if (us[i] - us[i - 1] > gap) {
+                gap = us[i] - us[i - 1];
+                gapEnd = i;
+            }
+        }
+        if (gapEnd != 0) {
+            // the visible longitudes wrap around
+            minU = us[gapEnd];
+            maxU = us[gapEnd - 1] + 1.0f;
+        } else {
+            minU = us.first();
+            maxU = us.last();
+        }
+    } else {
+        minU = std::max(us.first(), 0.0f);
+        maxU = std::min(us.last(), 1.0f);
+        if (minU > maxU)
+            return QRectF();
+    }
+    return QRectF(minU, minV, maxU - minU, maxV - minV);
+}
@@ -0,0 +1,42 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QRectF>
+#include <QMatrix4x4>
+
+#include "screen.hpp"
+
+
+/* Determine which part of the frame a view samples, in the coordinates that
+ * the view shader computes before it applies the input mode and the aspect
+ * ratio (see shader-view.frag.glsl). The results are conservative up to the
+ * sampling precision. An empty rectangle means that nothing is visible. */
+
+// For flat video: the region of the screen texture coordinates that is
+// visible. The screen is clipped against the view frustum.
+QRectF visibleScreenRegion(const Screen& screen, const QMatrix4x4& projectionModelViewMatrix);
+
+// For surround video: the region of the equirectangular coordinates that is
+// visible, for the given surround degrees (180 or 360). For 360 degrees, the
+// region extends beyond the right border if it wraps around.
+QRectF visibleSurroundRegion(const QMatrix4x4& projectionMatrix, const QMatrix4x4& orientationMatrix,
+        int surroundDegrees);
@@ -0,0 +1,135 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+uniform sampler2D frameTex;
+uniform int face;
+uniform float face_size;
+uniform int surround_degrees;
+uniform int projection; // 0 = equirectangular, 1 = 3x2 cube map, 2 = equi-angular cube map, 3 = fisheye
+uniform float fisheye_fov; // lens field of view, in radians
+uniform float view_offset_x;
+uniform float view_factor_x;
+uniform float view_offset_y;
+uniform float view_factor_y;
+
+const float pi = 3.14159265358979323846;
+
+layout(location = 0) out vec4 fcolor;
+
+void main(void)
+{
+    // Direction of this texel, following the cube map face layout of the
+    // OpenGL specification
+    vec2 st = 2.0 * gl_FragCoord.xy / face_size - 1.0;
+    vec3 dir;
+    if (face == 0)
+        dir = vec3(1.0, -st.y, -st.x);
+    else if (face == 1)
+        dir = vec3(-1.0, -st.y, st.x);
+    else if (face == 2)
+        dir = vec3(st.x, 1.0, st.y);
+    else if (face == 3)
+        dir = vec3(st.x, -1.0, -st.y);
+    else if (face == 4)
+        dir = vec3(st.x, -st.y, 1.0);
+    else
+        dir = vec3(-st.x, -st.y, -1.0);
+    dir = normalize(dir);
+
+    vec3 rgb = vec3(0.0);
+    if (projection == 0) {
+        // Equirectangular projection
+        float theta = asin(clamp(-dir.y, -1.0, 1.0));
+        float phi = atan(dir.x, -dir.z);
+        float u = phi / (surround_degrees == 360 ? 2.0 * pi : pi) + 0.5;
+        float v = theta / pi + 0.5;
+        if (u >= 0.0 && u <= 1.0) {
+            float vtx = view_offset_x + view_factor_x * u;
+            float vty = view_offset_y + view_factor_y * v;
+            rgb = texture(frameTex, vec2(vtx, vty)).rgb;
+        }
+    } else if (projection == 3) {
+        // Equidistant fisheye projection: the distance from the center of the
+        // image circle grows linearly with the angle to the optical axis
+        vec2 d = vec2(dir.x, -dir.y);
+        float l = length(d);
+        float r = atan(l, -dir.z) / (0.5 * fisheye_fov);
+        if (r <= 1.0) {
+            vec2 uv = 0.5 + 0.5 * r * (l > 0.0 ? d / l : vec2(0.0));
+            float vtx = view_offset_x + view_factor_x * uv.x;
+            float vty = view_offset_y + view_factor_y * uv.y;
+            rgb = texture(frameTex, vec2(vtx, vty)).rgb;
+        }
+    } else {
+        // Cube face layouts with three columns and two rows. Find the cell
+        // and the coordinates (a,b) within it, with a pointing right and b
+        // pointing down in the frame.
+        vec3 m = abs(dir);
+        vec2 cell;
+        float a, b;
+        if (projection == 1) {
+            // right, left, up / down, front, back
+            if (m.x >= m.y && m.x >= m.z) {
+                cell = (dir.x > 0.0 ? vec2(0.0, 0.0) : vec2(1.0, 0.0));
+                a = dir.z / dir.x;
+                b = -dir.y / m.x;
+            } else if (m.y >= m.z) {
+                cell = (dir.y > 0.0 ? vec2(2.0, 0.0) : vec2(0.0, 1.0));
+                a = dir.x / m.y;
+                b = -dir.z / dir.y;
+            } else {
+                cell = (dir.z < 0.0 ? vec2(1.0, 1.0) : vec2(2.0, 1.0));
+                a = -dir.x / dir.z;
+                b = -dir.y / m.z;
+            }
+        } else {
+            // left, front, right / down, back, up; the bottom row is rotated
+            // by 90 degrees clockwise
+            if (m.x >= m.y && m.x >= m.z) {
+                cell = (dir.x > 0.0 ? vec2(2.0, 0.0) : vec2(0.0, 0.0));
+                a = dir.z / dir.x;
+                b = -dir.y / m.x;
+            } else if (m.y >= m.z) {
+                cell = (dir.y > 0.0 ? vec2(2.0, 1.0) : vec2(0.0, 1.0));
+                a = -dir.z / dir.y;
+                b = -dir.x / m.y;
+            } else if (dir.z < 0.0) {
+                cell = vec2(1.0, 0.0);
+                a = dir.x / m.z;
+                b = -dir.y / m.z;
+            } else {
+                cell = vec2(1.0, 1.0);
+                a = dir.y / dir.z;
+                b = -dir.x / dir.z;
+            }
+            // equi-angular sampling: each cell covers 90 degrees uniformly
+            a = atan(a) * (4.0 / pi);
+            b = atan(b) * (4.0 / pi);
+        }
+        // Keep the bilinear filter from reading neighboring cells
+        vec2 cellSize = vec2(view_factor_x / 3.0, view_factor_y / 2.0) * vec2(textureSize(frameTex, 0));
+        vec2 ab = clamp(0.5 * vec2(a, b) + 0.5, 0.5 / cellSize, 1.0 - 0.5 / cellSize);
+        vec2 uv = (cell + ab) / vec2(3.0, 2.0);
+        float vtx = view_offset_x + view_factor_x * uv.x;
+        float vty = view_offset_y + view_factor_y * uv.y;
+        rgb = texture(frameTex, vec2(vtx, vty)).rgb;
+    }
+    fcolor = vec4(rgb, 1.0);
+}
@@ -18,13 +18,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-uniform sampler2D view0;
-uniform sampler2D view1;
+uniform sampler2DArray views; // one layer per view; mono frames have only one
 
 uniform float relativeWidth;
 uniform float relativeHeight;
 uniform float fragOffsetX;
 uniform float fragOffsetY;
+uniform mat4 reprojection; // for surround views; identity otherwise
 
 // This must be the same as OutputMode from modes.hpp:
 const int Output_Left = 0;
@@ -85,6 +85,15 @@ vec3 rgb_to_nonlinear(vec3 rgb)
     return vec3(to_nonlinear(rgb.r), to_nonlinear(rgb.g), to_nonlinear(rgb.b));
 }
 
+// view texture coordinates for the current orientation to those of the rendered view;
+// coordinates outside of the view stay outside so that they hit the black texture border
+vec2 reproject(vec2 tc)
+{
+    vec3 p = mat3(reprojection) * vec3(tc, 1.0);
+    bool inside = (tc.x >= 0.0 && tc.x <= 1.0 && tc.y >= 0.0 && tc.y <= 1.0 && p.z > 0.0);
+    return (inside ? p.xy / p.z : vec2(-1.0));
+}
+
 void main(void)
 {
     float tx = (vtexcoord.x - 0.5 * (1.0 - relativeWidth )) / relativeWidth;
@@ -103,76 +112,76 @@ void main(void)
         if (ty >= a) {
             if (tx >= 0.0 && tx <= 1.0) {
                 float tty = (ty - a) / (1.0 - a);
-                rgb = texture(view0, vec2(tx, tty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(tx, tty)), 0.0)).rgb;
             }
         } else if (ty < b) {
             if (tx >= 0.0 && tx <= 1.0) {
                 float tty = ty / b;
-                rgb = texture(view1, vec2(tx, tty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(tx, tty)), 1.0)).rgb;
             }
         }
     } else if (outputMode == Output_Left || outputMode == Output_Right) {
         if (outputModeLeftRightView == 0)
-            rgb = texture(view0, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 0.0)).rgb;
         else
-            rgb = texture(view1, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 1.0)).rgb;
     } else if (outputMode == Output_Left_Right || outputMode == Output_Left_Right_Half) {
         if (tx < 0.5) {
             if (ty >= 0.0 && ty <= 1.0)
-                rgb = texture(view0, vec2(2.0 * tx, ty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(2.0 * tx, ty)), 0.0)).rgb;
         } else {
             if (ty >= 0.0 && ty <= 1.0)
-                rgb = texture(view1, vec2(2.0 * tx - 1.0, ty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(2.0 * tx - 1.0, ty)), 1.0)).rgb;
         }
     } else if (outputMode == Output_Right_Left || outputMode == Output_Right_Left_Half) {
         if (tx < 0.5) {
             if (ty >= 0.0 && ty <= 1.0)
-                rgb = texture(view1, vec2(2.0 * tx, ty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(2.0 * tx, ty)), 1.0)).rgb;
         } else {
             if (ty >= 0.0 && ty <= 1.0)
-                rgb = texture(view0, vec2(2.0 * tx - 1.0, ty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(2.0 * tx - 1.0, ty)), 0.0)).rgb;
         }
     } else if (outputMode == Output_Top_Bottom || outputMode == Output_Top_Bottom_Half) {
         if (ty >= 0.5) {
             if (tx >= 0.0 && tx <= 1.0)
-                rgb = texture(view0, vec2(tx, 2.0 * ty - 1.0)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(tx, 2.0 * ty - 1.0)), 0.0)).rgb;
         } else {
             if (tx >= 0.0 && tx <= 1.0)
-                rgb = texture(view1, vec2(tx, 2.0 * ty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(tx, 2.0 * ty)), 1.0)).rgb;
         }
     } else if (outputMode == Output_Bottom_Top || outputMode == Output_Bottom_Top_Half) {
         if (ty >= 0.5) {
             if (tx >= 0.0 && tx <= 1.0)
-                rgb = texture(view1, vec2(tx, 2.0 * ty - 1.0)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(tx, 2.0 * ty - 1.0)), 1.0)).rgb;
         } else {
             if (tx >= 0.0 && tx <= 1.0)
-                rgb = texture(view0, vec2(tx, 2.0 * ty)).rgb;
+                rgb = texture(views, vec3(reproject(vec2(tx, 2.0 * ty)), 0.0)).rgb;
         }
     } else if (outputMode == Output_Even_Odd_Rows) {
         float fragmentY = gl_FragCoord.y - 0.5 + fragOffsetY;
         if (mod(fragmentY, 2.0) < 0.5) {
-            rgb = texture(view0, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 0.0)).rgb;
         } else {
-            rgb = texture(view1, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 1.0)).rgb;
         }
     } else if (outputMode == Output_Even_Odd_Columns) {
         float fragmentX = gl_FragCoord.x - 0.5 + fragOffsetX;
         if (mod(fragmentX, 2.0) < 0.5) {
-            rgb = texture(view0, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 0.0)).rgb;
         } else {
-            rgb = texture(view1, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 1.0)).rgb;
         }
     } else if (outputMode == Output_Checkerboard) {
         float fragmentX = gl_FragCoord.x - 0.5 + fragOffsetX;
         float fragmentY = gl_FragCoord.y - 0.5 + fragOffsetY;
         if (abs(mod(fragmentX, 2.0) - mod(fragmentY, 2.0)) < 0.5) {
-            rgb = texture(view0, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 0.0)).rgb;
         } else {
-            rgb = texture(view1, vec2(tx, ty)).rgb;
+            rgb = texture(views, vec3(reproject(vec2(tx, ty)), 1.0)).rgb;
         }
     } else {
-        vec3 rgb0 = texture(view0, vec2(tx, ty)).rgb;
-        vec3 rgb1 = texture(view1, vec2(tx, ty)).rgb;
+        vec3 rgb0 = texture(views, vec3(reproject(vec2(tx, ty)), 0.0)).rgb;
+        vec3 rgb1 = texture(views, vec3(reproject(vec2(tx, ty)), 1.0)).rgb;
         if (outputMode == Output_Red_Cyan_Dubois) {
             // Source of this matrix: http://www.site.uottawa.ca/~edubois/anaglyph/LeastSquaresHowToPhotoshop.pdf
             mat3 m0 = mat3(
@@ -20,19 +20,25 @@
 
 uniform sampler2D frameTex;
 uniform sampler2D subtitleTex;
+uniform samplerCube frameCube0; // per view, see Bino::renderViews()
+uniform samplerCube frameCube1;
 uniform float relative_width;
 uniform float relative_height;
-uniform float view_offset_x;
-uniform float view_factor_x;
-uniform float view_offset_y;
-uniform float view_factor_y;
+uniform float view_offset_x[$VIEW_COUNT];
+uniform float view_factor_x[$VIEW_COUNT];
+uniform float view_offset_y[$VIEW_COUNT];
+uniform float view_factor_y[$VIEW_COUNT];
 int surroundDegrees = $SURROUND_DEGREES;
 const bool nonlinear_output = $NONLINEAR_OUTPUT;
+const bool fused_color_conversion = $FUSED_COLOR_CONVERSION;
 
-smooth in vec2 vtexcoord;
-smooth in vec3 vdirection;
+$COLOR_CONVERSION
 
-const float pi = 3.14159265358979323846;
+in ViewVertex {
+    smooth vec2 texcoord;
+    smooth vec3 direction;
+    flat int view;
+} vin;
 
 layout(location = 0) out vec4 fcolor;
 
@@ -51,22 +57,21 @@ void main(void)
 {
     vec3 rgb;
     if (surroundDegrees > 0) {
-        vec3 dir = normalize(vdirection);
-        float theta = asin(clamp(-dir.y, -1.0, 1.0));
-        float phi = atan(dir.x, -dir.z);
-	float tmp = (surroundDegrees == 360 ? 2.0f * pi : pi);
-        float u = phi / tmp + 0.5;
-        float v = theta / pi + 0.5;
-        float vtx = view_offset_x + view_factor_x * u;
-        float vty = view_offset_y + view_factor_y * v;
-        rgb = texture(frameTex, vec2(vtx, vty)).rgb;
+        // The frame was projected into a cube map, see shader-cubemap.frag.glsl
+        if (vin.view == 0)
+            rgb = texture(frameCube0, vin.direction).rgb;
+        else
+            rgb = texture(frameCube1, vin.direction).rgb;
     } else {
-        float vtx = view_offset_x + view_factor_x * vtexcoord.x;
-        float vty = view_offset_y + view_factor_y * vtexcoord.y;
+        float vtx = view_offset_x[vin.view] + view_factor_x[vin.view] * vin.texcoord.x;
+        float vty = view_offset_y[vin.view] + view_factor_y[vin.view] * vin.texcoord.y;
         float tx = (      vtx - 0.5 * (1.0 - relative_width )) / relative_width;
         float ty = (1.0 - vty - 0.5 * (1.0 - relative_height)) / relative_height;
-        rgb = texture(frameTex, vec2(tx, ty)).rgb;
-        vec4 sub = texture(subtitleTex, vec2(vtexcoord.x, 1.0 - vtexcoord.y)).rgba;
+        if (fused_color_conversion)
+            rgb = planes_to_linear_rgb(vec2(tx, ty));
+        else
+            rgb = texture(frameTex, vec2(tx, ty)).rgb;
+        vec4 sub = texture(subtitleTex, vec2(vin.texcoord.x, 1.0 - vin.texcoord.y)).rgba;
         rgb = mix(rgb, sub.rgb, sub.a);
     }
     if (nonlinear_output) {
@@ -0,0 +1,57 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// This shader is only used for rendering both views in a single pass;
+// see Bino::renderStereo().
+
+uniform mat4 projectionModelViewMatrix[2];
+uniform mat4 orientationMatrix[2];
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 6) out;
+
+in ViewVertex {
+    smooth vec2 texcoord;
+    smooth vec3 direction;
+    flat int view;
+} vin[];
+
+out ViewVertex {
+    smooth vec2 texcoord;
+    smooth vec3 direction;
+    flat int view;
+} vout;
+
+void main(void)
+{
+    // Emit each triangle once per view, into the texture layer of that view
+    for (int v = 0; v < 2; v++) {
+        for (int i = 0; i < 3; i++) {
+            vec4 position = gl_in[i].gl_Position;
+            gl_Layer = v;
+            vout.texcoord = vin[i].texcoord;
+            vout.direction = (position * orientationMatrix[v]).xyz;
+            vout.view = v;
+            gl_Position = projectionModelViewMatrix[v] * position;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -18,18 +18,29 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-uniform mat4 projectionModelViewMatrix;
-uniform mat4 orientationMatrix;
+uniform mat4 projectionModelViewMatrix[$VIEW_COUNT];
+uniform mat4 orientationMatrix[$VIEW_COUNT];
+const bool layered = $LAYERED;
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec2 texcoord;
 
-smooth out vec2 vtexcoord;
-smooth out vec3 vdirection;
+out ViewVertex {
+    smooth vec2 texcoord;
+    smooth vec3 direction;
+    flat int view;
+} vout;
 
 void main(void)
 {
-    vtexcoord = texcoord;
-    vdirection = (position * orientationMatrix).xyz;
-    gl_Position = projectionModelViewMatrix * position;
+    vout.texcoord = texcoord;
+    vout.view = 0;
+    if (layered) {
+        // the geometry shader transforms the vertex for each view
+        vout.direction = vec3(0.0);
+        gl_Position = position;
+    } else {
+        vout.direction = (position * orientationMatrix[0]).xyz;
+        gl_Position = projectionModelViewMatrix[0] * position;
+    }
 }
@@ -18,6 +18,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cmath>
+#include <algorithm>
+
 #include <QFile>
 #include <QTextStream>
 #include <QOpenGLContext>
@@ -40,6 +43,25 @@ bool checkTextureAnisotropicFilterAvailability()
         || QOpenGLContext::currentContext()->hasExtension("GL_EXT_texture_filter_anisotropic");
 }
 
+bool checkTextureStorageAvailability()
+{
+    QOpenGLContext* ctx = QOpenGLContext::currentContext();
+    return ctx->isOpenGLES()
+        || ctx->format().majorVersion() > 4
+        || (ctx->format().majorVersion() == 4 && ctx->format().minorVersion() >= 2)
+        || ctx->hasExtension("GL_ARB_texture_storage");
+}
+
+int mipmapMaxLevel(float minificationRatio, int levels)
+{
+    if (!(minificationRatio > 1.0f)) // also catches NaN
+        return 0;
+    // Trilinear filtering blends the two levels around the fractional
+    // level of detail log2(ratio), so we need the level above it.
+    int level = std::ceil(std::log2(minificationRatio));
+    return std::min(level, levels - 1);
+}
+
 const char* getOpenGLString(QOpenGLExtraFunctions* gl, GLenum p)
 {
     return reinterpret_cast<const char*>(gl->glGetString(p));
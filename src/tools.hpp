@@ -43,5 +43,14 @@ QString readFile(const char* fileName);
 #endif
 bool checkTextureAnisotropicFilterAvailability();
 
+// Check for immutable texture storage (glTexStorage2D), which is part of
+// OpenGL ES 3.0 and OpenGL 4.2 and available via GL_ARB_texture_storage
+bool checkTextureStorageAvailability();
+
+// Return the highest mipmap level that trilinear filtering accesses when
+// a texture is minified by the given ratio of texels per pixel,
+// clamped to the given level count
+int mipmapMaxLevel(float minificationRatio, int levels);
+
 // Shortcut to get a string from OpenGL
 const char* getOpenGLString(QOpenGLExtraFunctions* gl, GLenum p);
@@ -0,0 +1,182 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <utility>
+
+#include "uploadthread.hpp"
+#include "bino.hpp"
+#include "log.hpp"
+
+
+UploadThread::UploadThread() :
+    _context(nullptr),
+    _quit(false),
+    _haveRequest(false),
+    _requestTime(-1),
+    _uploadIndex(0),
+    _readyIndex(1),
+    _haveReadyGeneration(false)
+{
+    for (int i = 0; i < 2; i++) {
+        _generations[i].frameTex = 0;
+        _generations[i].extFrameTex = 0;
+        _generations[i].readyFence = nullptr;
+        _generations[i].releaseFence = nullptr;
+    }
+    _surface = new QOffscreenSurface;
+    _surface->setFormat(QSurfaceFormat::defaultFormat());
+    _surface->create();
+}
+
+UploadThread::~UploadThread()
+{
+    stop();
+    delete _context;
+    delete _surface;
+}
+
+void UploadThread::startUploading(QOpenGLContext* shareContext)
+{
+    _context = new QOpenGLContext;
+    _context->setFormat(shareContext->format());
+    _context->setShareContext(shareContext);
+    if (!_context->create())
+        LOG_FATAL("cannot create OpenGL context for the upload thread");
+    _context->moveToThread(this);
+    start();
+}
+
+void UploadThread::stop()
+{
+    _mutex.lock();
+    _quit = true;
+    _wakeup.wakeOne();
+    _mutex.unlock();
+    wait();
+}
+
+void UploadThread::requestFrame(qint64 mediaTime)
+{
+    _mutex.lock();
+    _requestTime = mediaTime;
+    _haveRequest = true;
+    _wakeup.wakeOne();
+    _mutex.unlock();
+}
+
+bool UploadThread::frameAvailable()
+{
+    QMutexLocker locker(&_mutex);
+    return _haveReadyGeneration;
+}
+
+GLsync UploadThread::takeFrame(VideoFrame* frame, VideoFrame* extFrame,
+        unsigned int* frameTex, FrameUploader::TexStorage* frameTexStorage,
+        unsigned int* extFrameTex, FrameUploader::TexStorage* extFrameTexStorage,
+        GLsync releaseFence)
+{
+    QMutexLocker locker(&_mutex);
+    Q_ASSERT(_haveReadyGeneration);
+    Generation& g = _generations[_readyIndex];
+    std::swap(*frame, g.frame);
+    std::swap(*extFrame, g.extFrame);
+    std::swap(*frameTex, g.frameTex);
+    std::swap(*frameTexStorage, g.frameTexStorage);
+    std::swap(*extFrameTex, g.extFrameTex);
+    std::swap(*extFrameTexStorage, g.extFrameTexStorage);
+    GLsync readyFence = g.readyFence;
+    g.readyFence = nullptr;
+    g.releaseFence = releaseFence;
+    _haveReadyGeneration = false;
+    return readyFence;
+}
+
+void UploadThread::run()
+{
+    _context->makeCurrent(_surface);
+    initializeOpenGLFunctions();
+    _renderTargetPool.initialize();
+    _frameUploader.initialize(&_renderTargetPool);
+    for (int i = 0; i < 2; i++) {
+        _frameUploader.createFrameTexture(&_generations[i].frameTex, &_generations[i].frameTexStorage);
+        _frameUploader.createFrameTexture(&_generations[i].extFrameTex, &_generations[i].extFrameTexStorage);
+    }
+    LOG_DEBUG("upload thread started");
+
+    for (;;) {
+        _mutex.lock();
+        while (!_quit && !_haveRequest)
+            _wakeup.wait(&_mutex);
+        bool quit = _quit;
+        qint64 mediaTime = _requestTime;
+        _haveRequest = false;
+        Generation& g = _generations[_uploadIndex];
+        _mutex.unlock();
+        if (quit)
+            break;
+
+        // Take the frame from the queue. A generation that was finished but
+        // never taken by the renderer is overwritten; its frames go back into
+        // the queue for reuse.
+        bool framesPending;
+        if (!Bino::instance()->takeFrameFromQueue(mediaTime, &g.frame, &g.extFrame, &framesPending)) {
+            if (framesPending)
+                emit frameReady();
+            continue;
+        }
+        if (g.readyFence) {
+            glDeleteSync(g.readyFence);
+            g.readyFence = nullptr;
+        }
+        // Wait until the renderer does not sample the textures anymore
+        if (g.releaseFence) {
+            glWaitSync(g.releaseFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(g.releaseFence);
+            g.releaseFence = nullptr;
+        }
+
+        // Upload and convert, as Bino::preRenderProcess() would
+        _frameUploader.convertFrameToTexture(g.frame, &g.frameTex, &g.frameTexStorage);
+        if (g.frame.inputMode == Input_Alternating_LR
+                || g.frame.inputMode == Input_Alternating_RL) {
+            if (g.extFrame.width != g.frame.width || g.extFrame.height != g.frame.height)
+                _frameUploader.convertFrameToTexture(g.frame, &g.extFrameTex, &g.extFrameTexStorage);
+            else
+                _frameUploader.convertFrameToTexture(g.extFrame, &g.extFrameTex, &g.extFrameTexStorage);
+        }
+        g.readyFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        _mutex.lock();
+        std::swap(_uploadIndex, _readyIndex);
+        _haveReadyGeneration = true;
+        _mutex.unlock();
+        emit frameReady();
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (_generations[i].readyFence)
+            glDeleteSync(_generations[i].readyFence);
+        if (_generations[i].releaseFence)
+            glDeleteSync(_generations[i].releaseFence);
+    }
+    _context->doneCurrent();
+    LOG_DEBUG("upload thread finished");
+}
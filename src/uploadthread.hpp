@@ -0,0 +1,109 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLExtraFunctions>
+
+#include "videoframe.hpp"
+#include "frameuploader.hpp"
+#include "rendertargetpool.hpp"
+
+
+/* A thread that takes frames from Bino's frame queue, uploads them and
+ * converts them to frame textures in its own OpenGL context, which shares
+ * objects with the rendering context. This way, the upload and conversion of
+ * the next frame overlap the rendering of the current one.
+ *
+ * Finished frames are handed over in generations. A generation consists of
+ * the video frames and the frame textures that hold their converted data.
+ * The renderer swaps the newest finished generation with its own frames and
+ * textures, so that textures rotate between the renderer and two generations.
+ * Fences order the accesses of both contexts to the textures. */
+class UploadThread : public QThread, protected QOpenGLExtraFunctions
+{
+Q_OBJECT
+
+private:
+    struct Generation {
+        VideoFrame frame;
+        VideoFrame extFrame; // for alternating stereo
+        unsigned int frameTex;
+        FrameUploader::TexStorage frameTexStorage;
+        unsigned int extFrameTex;
+        FrameUploader::TexStorage extFrameTexStorage;
+        GLsync readyFence;   // signaled when upload and conversion are finished
+        GLsync releaseFence; // signaled when the renderer has finished sampling the textures
+    };
+
+    QOpenGLContext* _context;
+    QOffscreenSurface* _surface;
+    RenderTargetPool _renderTargetPool;
+    FrameUploader _frameUploader;
+
+    QMutex _mutex;            // protects the following members
+    QWaitCondition _wakeup;
+    bool _quit;
+    bool _haveRequest;
+    qint64 _requestTime;      // media time for frame selection, see Bino::frameSelectionTime()
+    Generation _generations[2];
+    int _uploadIndex;         // generation owned by the upload thread
+    int _readyIndex;          // newest finished generation
+    bool _haveReadyGeneration;
+
+protected:
+    void run() override;
+
+public:
+    // Create the offscreen surface; this must be called on the GUI thread.
+    UploadThread();
+    virtual ~UploadThread();
+
+    // Create the context, sharing objects with the given context, and start
+    // the thread.
+    void startUploading(QOpenGLContext* shareContext);
+    // Stop the thread and wait for it to finish.
+    void stop();
+
+    // Request that the frame for the given media time is taken from the queue
+    // and uploaded. Requests replace each other, only the newest one is done.
+    void requestFrame(qint64 mediaTime);
+
+    // Renderer side: is a newly uploaded frame available?
+    bool frameAvailable();
+    // Renderer side: swap the newly uploaded frames and their textures with the
+    // given ones. The release fence must be signaled when the renderer has
+    // finished sampling the given textures. Returns a fence that the renderer
+    // must wait for (and then delete) before sampling the new textures.
+    GLsync takeFrame(VideoFrame* frame, VideoFrame* extFrame,
+            unsigned int* frameTex, FrameUploader::TexStorage* frameTexStorage,
+            unsigned int* extFrameTex, FrameUploader::TexStorage* extFrameTexStorage,
+            GLsync releaseFence);
+
+signals:
+    // Emitted when a frame was uploaded, and when queued frames were not
+    // due yet so that a new frame should be requested later.
+    void frameReady();
+};
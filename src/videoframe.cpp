@@ -18,6 +18,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
+
+#include <QtEndian>
+#include <QElapsedTimer>
+
 #include "videoframe.hpp"
 #include "log.hpp"
 
@@ -95,9 +100,22 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
                 || qframe.pixelFormat() == QVideoFrameFormat::Format_P010
                 || qframe.pixelFormat() == QVideoFrameFormat::Format_P016
                 || qframe.pixelFormat() == QVideoFrameFormat::Format_Y8
-                || qframe.pixelFormat() == QVideoFrameFormat::Format_Y16) {
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_Y16
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_NV21
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_UYVY
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_YUYV
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_AYUV
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_AYUV_Premultiplied
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_IMC1
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_IMC2
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_IMC3
+                || qframe.pixelFormat() == QVideoFrameFormat::Format_IMC4) {
             fallbackToImage = false;
         }
+#if QT_VERSION >= QT_VERSION_CHECK(6, 4, 0)
+        if (qframe.pixelFormat() == QVideoFrameFormat::Format_YUV420P10)
+            fallbackToImage = false;
+#endif
         if (fallbackToImage) {
             if (newSrc) {
                 LOG_WARNING("%s", qPrintable(tr("Pixel format %1 is not hardware accelerated!")
@@ -107,8 +125,6 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
             pixelFormat = QVideoFrameFormat::pixelFormatFromImageFormat(QImage::Format_RGB32);
             yuvValueRangeSmall = false;
             yuvSpace = YUV_AdobeRgb;
-            image = qframe.toImage();
-            image.convertTo(QImage::Format_RGB32);
         } else {
             storage = Storage_Mapped;
             pixelFormat = qframe.pixelFormat();
@@ -141,14 +157,8 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
                 yuvSpace = YUV_AdobeRgb;
                 break;
             }
-            qframe.map(QVideoFrame::ReadOnly);
-            planeCount = qframe.planeCount();
-            for (int p = 0; p < planeCount; p++) {
-                bytesPerLine[p] = qframe.bytesPerLine(p);
-                bytesPerPlane[p] = qframe.mappedBytes(p);
-                mappedBits[p] = qframe.bits(p);
-            }
         }
+        dataIsPrepared = false;
         subtitle = qframe.subtitleText();
         subtitle.replace(QLatin1Char('\n'), QChar::LineSeparator); // qvideoframe.cpp does this
     } else {
@@ -160,6 +170,7 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
         storage = Storage_Image;
         image = QImage(width, height, QImage::Format_RGB32);
         image.fill(0);
+        dataIsPrepared = true;
         aspectRatio = 1.0f;
         subtitle = QString();
     }
@@ -168,6 +179,34 @@ void VideoFrame::update(InputMode im, SurroundMode sm, const QVideoFrame& frame,
 void VideoFrame::reUpdate()
 {
     update(inputMode, surroundMode, qframe, false);
+    prepareData();
+}
+
+void VideoFrame::prepareData()
+{
+    if (dataIsPrepared)
+        return;
+    if (storage == Storage_Image) {
+        image = qframe.toImage();
+        // The 32 bit ARGB formats have the same memory layout as RGB32, and
+        // alpha is ignored by the color conversion, so avoid another full
+        // frame conversion pass for them.
+        if (image.format() != QImage::Format_RGB32
+                && image.format() != QImage::Format_ARGB32
+                && image.format() != QImage::Format_ARGB32_Premultiplied) {
+            image.convertTo(QImage::Format_RGB32);
+        }
+    } else {
+        LOG_FIREHOSE("videoframe maps %dx%d frame", width, height);
+        qframe.map(QVideoFrame::ReadOnly);
+        planeCount = qframe.planeCount();
+        for (int p = 0; p < planeCount; p++) {
+            bytesPerLine[p] = qframe.bytesPerLine(p);
+            bytesPerPlane[p] = qframe.mappedBytes(p);
+            mappedBits[p] = qframe.bits(p);
+        }
+    }
+    dataIsPrepared = true;
 }
 
 void VideoFrame::invalidate()
@@ -176,90 +215,316 @@ void VideoFrame::invalidate()
         update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
 }
 
-QDataStream &operator<<(QDataStream& ds, const VideoFrame& f)
+/* Wire format of a serialized frame:
+ * - the header below, with all fields in little endian byte order
+ * - the subtitle in UTF-8, with the size given in the header
+ * - the payloads (the planes, or the QImage data), with the sizes given
+ *   in the header
+ * The receiver reads the payloads directly into reused buffers. */
+
+static const quint32 wireMagic = 0x46564942; // "BIVF"
+static const quint16 wireVersion = 2;
+
+// Limits for the sanity checks of received headers
+static const int wireMaxSize = 32768;
+static const int wireMaxBytesPerPixel = 16;
+static const quint32 wireMaxSubtitleSize = 65536;
+
+struct WireHeader {
+    quint32 magic;
+    quint16 version;
+    quint16 headerSize;
+    qint32 inputMode;
+    qint32 surroundMode;
+    qint32 width;
+    qint32 height;
+    quint32 aspectRatio; // bits of the float
+    qint32 storage;
+    qint32 pixelFormat;
+    qint32 yuvValueRangeSmall;
+    qint32 yuvSpace;
+    qint32 planeCount;
+    qint32 bytesPerLine[3];
+    qint32 bytesPerPlane[3];
+    quint32 subtitleSize;
+    quint32 reserved;
+};
+static_assert(sizeof(WireHeader) == 80, "unexpected wire header size");
+
+static bool wireHeaderIsValid(const WireHeader& h)
+{
+    if (qFromLittleEndian(h.magic) != wireMagic
+            || qFromLittleEndian(h.version) != wireVersion
+            || qFromLittleEndian(h.headerSize) != sizeof(WireHeader))
+        return false;
+    int width = qFromLittleEndian(h.width);
+    int height = qFromLittleEndian(h.height);
+    if (width < 1 || width > wireMaxSize || height < 1 || height > wireMaxSize
+            || qFromLittleEndian(h.subtitleSize) > wireMaxSubtitleSize)
+        return false;
+    int storage = qFromLittleEndian(h.storage);
+    if (storage == VideoFrame::Storage_Image)
+        return true;
+    if (storage != VideoFrame::Storage_Copied)
+        return false;
+    QVideoFrameFormat::PixelFormat pixelFormat = static_cast<QVideoFrameFormat::PixelFormat>(qFromLittleEndian(h.pixelFormat));
+    int rows[3], minBytesPerLine[3];
+    int planeCount = VideoFrame::planeLayout(pixelFormat, width, height, rows, minBytesPerLine);
+    if (planeCount == 0 || qFromLittleEndian(h.planeCount) != planeCount)
+        return false;
+    for (int p = 0; p < planeCount; p++) {
+        // The lines must hold the texels that the upload reads, and the plane
+        // must hold all its lines; the last one does not need padding.
+        // No plane has more lines than the frame or more bytes per pixel
+        // than the largest pixel format.
+        qint64 bytesPerLine = qFromLittleEndian(h.bytesPerLine[p]);
+        qint64 bytesPerPlane = qFromLittleEndian(h.bytesPerPlane[p]);
+        qint64 lastLineBytes = minBytesPerLine[p];
+        if (p == 1 && (pixelFormat == QVideoFrameFormat::Format_IMC2 || pixelFormat == QVideoFrameFormat::Format_IMC4))
+            lastLineBytes = bytesPerLine / 2 + minBytesPerLine[p] / 2; // see FrameUploader::uploadFrame()
+        if (bytesPerLine < minBytesPerLine[p] || bytesPerLine > qint64(wireMaxBytesPerPixel) * width
+                || bytesPerPlane < bytesPerLine * (rows[p] - 1) + lastLineBytes
+                || bytesPerPlane > bytesPerLine * height)
+            return false;
+    }
+    return true;
+}
+
+void VideoFrame::serialize(QDataStream& ds, bool withData) const
 {
-    ds << static_cast<int>(f.inputMode);
-    ds << static_cast<int>(f.surroundMode);
-    ds << f.subtitle;
-    ds << f.width;
-    ds << f.height;
-    ds << f.aspectRatio;
-    switch (f.storage) {
-    case VideoFrame::Storage_Mapped:
-    case VideoFrame::Storage_Copied:
-        ds << static_cast<int>(VideoFrame::Storage_Copied);
-        ds << static_cast<int>(f.pixelFormat);
-        ds << f.yuvValueRangeSmall;
-        ds << static_cast<int>(f.yuvSpace);
-        ds << f.planeCount;
-        for (int p = 0; p < f.planeCount; p++) {
-            ds << f.bytesPerLine[p];
-            ds << f.bytesPerPlane[p];
-            if (f.storage == VideoFrame::Storage_Mapped)
-                ds.writeRawData(reinterpret_cast<const char*>(f.mappedBits[p]), f.bytesPerPlane[p]);
+    Q_ASSERT(dataIsPrepared);
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray subtitleUtf8 = subtitle.toUtf8();
+    WireHeader h = {};
+    h.magic = qToLittleEndian(wireMagic);
+    h.version = qToLittleEndian(wireVersion);
+    h.headerSize = qToLittleEndian(quint16(sizeof(WireHeader)));
+    h.inputMode = qToLittleEndian(qint32(inputMode));
+    h.surroundMode = qToLittleEndian(qint32(surroundMode));
+    h.width = qToLittleEndian(qint32(width));
+    h.height = qToLittleEndian(qint32(height));
+    quint32 aspectRatioBits;
+    std::memcpy(&aspectRatioBits, &aspectRatio, sizeof(aspectRatioBits));
+    h.aspectRatio = qToLittleEndian(aspectRatioBits);
+    h.subtitleSize = qToLittleEndian(quint32(subtitleUtf8.size()));
+    int payloadCount;
+    if (storage == Storage_Image) {
+        h.storage = qToLittleEndian(qint32(Storage_Image));
+        payloadCount = 1;
+    } else {
+        // mapped data is received as copied data
+        h.storage = qToLittleEndian(qint32(Storage_Copied));
+        h.pixelFormat = qToLittleEndian(qint32(pixelFormat));
+        h.yuvValueRangeSmall = qToLittleEndian(qint32(yuvValueRangeSmall ? 1 : 0));
+        h.yuvSpace = qToLittleEndian(qint32(yuvSpace));
+        h.planeCount = qToLittleEndian(qint32(planeCount));
+        for (int p = 0; p < planeCount; p++) {
+            h.bytesPerLine[p] = qToLittleEndian(qint32(bytesPerLine[p]));
+            h.bytesPerPlane[p] = qToLittleEndian(qint32(bytesPerPlane[p]));
+        }
+        payloadCount = planeCount;
+    }
+    ds.writeRawData(reinterpret_cast<const char*>(&h), sizeof(h));
+    ds.writeRawData(subtitleUtf8.constData(), subtitleUtf8.size());
+    if (withData) {
+        for (int p = 0; p < payloadCount; p++) {
+            if (storage == Storage_Image)
+                ds.writeRawData(reinterpret_cast<const char*>(image.constBits()), image.sizeInBytes());
             else
-                ds.writeRawData(reinterpret_cast<const char*>(f.bits[p].data()), f.bytesPerPlane[p]);
+                ds.writeRawData(reinterpret_cast<const char*>(planeData(p)), bytesPerPlane[p]);
         }
-        break;
-    case VideoFrame::Storage_Image:
-        ds.writeRawData(reinterpret_cast<const char*>(f.image.bits()), f.image.sizeInBytes());
-        break;
     }
-    return ds;
+    LOG_FIREHOSE("videoframe serialized %dx%d frame in %lld us", width, height, timer.nsecsElapsed() / 1000);
 }
 
-QDataStream &operator>>(QDataStream& ds, VideoFrame& f)
+void VideoFrame::deserialize(QDataStream& ds, bool withData)
 {
-    int tmp;
+    QElapsedTimer timer;
+    timer.start();
 
-    ds >> tmp;
-    f.inputMode = static_cast<InputMode>(tmp);
-    ds >> tmp;
-    f.surroundMode = static_cast<SurroundMode>(tmp);
-    ds >> f.subtitle;
-    ds >> f.width;
-    ds >> f.height;
-    ds >> f.aspectRatio;
-    ds >> tmp;
-    f.storage = static_cast<enum VideoFrame::Storage>(tmp);
-    switch (f.storage) {
-    case VideoFrame::Storage_Mapped: // cannot happen, see above
-    case VideoFrame::Storage_Copied:
-        f.image = QImage();
-        ds >> tmp;
-        f.pixelFormat = static_cast<QVideoFrameFormat::PixelFormat>(tmp);
-        ds >> f.yuvValueRangeSmall;
-        ds >> tmp;
-        f.yuvSpace = static_cast<enum VideoFrame::YUVSpace>(tmp);
-        ds >> f.planeCount;
+    WireHeader h;
+    if (ds.readRawData(reinterpret_cast<char*>(&h), sizeof(h)) != int(sizeof(h)) || !wireHeaderIsValid(h)) {
+        LOG_WARNING("invalid or incompatible video frame data");
+        ds.setStatus(QDataStream::ReadCorruptData);
+        update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
+        return;
+    }
+    inputMode = static_cast<InputMode>(qFromLittleEndian(h.inputMode));
+    surroundMode = static_cast<SurroundMode>(qFromLittleEndian(h.surroundMode));
+    width = qFromLittleEndian(h.width);
+    height = qFromLittleEndian(h.height);
+    quint32 aspectRatioBits = qFromLittleEndian(h.aspectRatio);
+    std::memcpy(&aspectRatio, &aspectRatioBits, sizeof(aspectRatio));
+    QByteArray subtitleUtf8(qFromLittleEndian(h.subtitleSize), Qt::Uninitialized);
+    bool complete = (ds.readRawData(subtitleUtf8.data(), subtitleUtf8.size()) == subtitleUtf8.size());
+    subtitle = QString::fromUtf8(subtitleUtf8);
+    storage = static_cast<enum Storage>(qFromLittleEndian(h.storage));
+    dataIsPrepared = true;
+    if (storage == Storage_Image) {
+        pixelFormat = QVideoFrameFormat::pixelFormatFromImageFormat(QImage::Format_RGB32);
+        yuvValueRangeSmall = false;
+        yuvSpace = YUV_AdobeRgb;
+        planeCount = 0;
+        for (int p = 0; p < 3; p++) {
+            bytesPerLine[p] = 0;
+            bytesPerPlane[p] = 0;
+            mappedBits[p] = nullptr;
+            bits[p].clear();
+        }
+        if (withData) {
+            // Reuse the image memory if possible
+            if (image.width() != width || image.height() != height || image.format() != QImage::Format_RGB32)
+                image = QImage(width, height, QImage::Format_RGB32);
+            complete = complete && (ds.readRawData(reinterpret_cast<char*>(image.bits()), image.sizeInBytes()) == image.sizeInBytes());
+        } else {
+            image = QImage();
+        }
+    } else {
+        image = QImage();
+        pixelFormat = static_cast<QVideoFrameFormat::PixelFormat>(qFromLittleEndian(h.pixelFormat));
+        yuvValueRangeSmall = (qFromLittleEndian(h.yuvValueRangeSmall) != 0);
+        yuvSpace = static_cast<enum YUVSpace>(qFromLittleEndian(h.yuvSpace));
+        planeCount = qFromLittleEndian(h.planeCount);
         for (int p = 0; p < 3; p++) {
-            if (p < f.planeCount) {
-                ds >> f.bytesPerLine[p];
-                ds >> f.bytesPerPlane[p];
-                f.bits[p].resize(f.bytesPerPlane[p]);
-                ds.readRawData(reinterpret_cast<char*>(f.bits[p].data()), f.bytesPerPlane[p]);
+            if (p < planeCount) {
+                bytesPerLine[p] = qFromLittleEndian(h.bytesPerLine[p]);
+                bytesPerPlane[p] = qFromLittleEndian(h.bytesPerPlane[p]);
+                if (withData) {
+                    // The vectors keep their capacity, so this does not
+                    // reallocate as long as the frame size stays the same
+                    bits[p].resize(bytesPerPlane[p]);
+                    complete = complete && (ds.readRawData(reinterpret_cast<char*>(bits[p].data()), bytesPerPlane[p]) == bytesPerPlane[p]);
+                }
             } else {
-                f.bytesPerLine[p] = 0;
-                f.bytesPerPlane[p] = 0;
-                f.bits[p].clear();
+                bytesPerLine[p] = 0;
+                bytesPerPlane[p] = 0;
+                bits[p].clear();
             }
-            f.mappedBits[p] = nullptr;
+            mappedBits[p] = nullptr;
         }
+    }
+    if (!complete) {
+        LOG_WARNING("incomplete video frame data");
+        ds.setStatus(QDataStream::ReadPastEnd);
+        update(Input_Unknown, Surround_Unknown, QVideoFrame(), false);
+        return;
+    }
+    LOG_FIREHOSE("videoframe deserialized %dx%d frame in %lld us", width, height, timer.nsecsElapsed() / 1000);
+}
+
+const uchar* VideoFrame::planeData(int p) const
+{
+    return (storage == Storage_Mapped ? mappedBits[p] : bits[p].data());
+}
+
+int VideoFrame::planeLayout(QVideoFrameFormat::PixelFormat pixelFormat, int width, int height,
+        int rows[3], int minBytesPerLine[3])
+{
+    // This must match FrameUploader::uploadFrame()
+    int planeCount;
+    switch (pixelFormat) {
+    case QVideoFrameFormat::Format_ARGB8888:
+    case QVideoFrameFormat::Format_ARGB8888_Premultiplied:
+    case QVideoFrameFormat::Format_XRGB8888:
+    case QVideoFrameFormat::Format_BGRA8888:
+    case QVideoFrameFormat::Format_BGRA8888_Premultiplied:
+    case QVideoFrameFormat::Format_BGRX8888:
+    case QVideoFrameFormat::Format_ABGR8888:
+    case QVideoFrameFormat::Format_XBGR8888:
+    case QVideoFrameFormat::Format_RGBA8888:
+    case QVideoFrameFormat::Format_RGBX8888:
+    case QVideoFrameFormat::Format_AYUV:
+    case QVideoFrameFormat::Format_AYUV_Premultiplied:
+        planeCount = 1;
+        rows[0] = height;
+        minBytesPerLine[0] = 4 * width;
         break;
-    case VideoFrame::Storage_Image:
-        f.pixelFormat = QVideoFrameFormat::pixelFormatFromImageFormat(QImage::Format_RGB32);
-        f.yuvValueRangeSmall = false;
-        f.yuvSpace = VideoFrame::YUV_AdobeRgb;
-        f.planeCount = 0;
-        for (int p = 0; p < 3; p++) {
-            f.bytesPerLine[p] = 0;
-            f.bytesPerPlane[p] = 0;
-            f.mappedBits[p] = nullptr;
-            f.bits[p].clear();
-        }
-        f.image = QImage(f.width, f.height, QImage::Format_RGB32);
-        ds.readRawData(reinterpret_cast<char*>(f.image.bits()), f.image.sizeInBytes());
+    case QVideoFrameFormat::Format_YUV420P:
+    case QVideoFrameFormat::Format_YV12:
+    case QVideoFrameFormat::Format_IMC1:
+    case QVideoFrameFormat::Format_IMC3:
+        planeCount = 3;
+        rows[0] = height;
+        rows[1] = rows[2] = height / 2;
+        minBytesPerLine[0] = width;
+        minBytesPerLine[1] = minBytesPerLine[2] = width / 2;
+        break;
+    case QVideoFrameFormat::Format_YUV422P:
+        planeCount = 3;
+        rows[0] = rows[1] = rows[2] = height;
+        minBytesPerLine[0] = width;
+        minBytesPerLine[1] = minBytesPerLine[2] = width / 2;
+        break;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 4, 0)
+    case QVideoFrameFormat::Format_YUV420P10:
+        planeCount = 3;
+        rows[0] = height;
+        rows[1] = rows[2] = height / 2;
+        minBytesPerLine[0] = 2 * width;
+        minBytesPerLine[1] = minBytesPerLine[2] = 2 * (width / 2);
         break;
+#endif
+    case QVideoFrameFormat::Format_IMC2:
+    case QVideoFrameFormat::Format_IMC4:
+        // each chroma line holds both chroma lines at half stride boundaries
+        planeCount = 2;
+        rows[0] = height;
+        rows[1] = height / 2;
+        minBytesPerLine[0] = width;
+        minBytesPerLine[1] = 2 * (width / 2);
+        break;
+    case QVideoFrameFormat::Format_NV12:
+    case QVideoFrameFormat::Format_NV21:
+        planeCount = 2;
+        rows[0] = height;
+        rows[1] = height / 2;
+        minBytesPerLine[0] = width;
+        minBytesPerLine[1] = 2 * (width / 2);
+        break;
+    case QVideoFrameFormat::Format_P010:
+    case QVideoFrameFormat::Format_P016:
+        planeCount = 2;
+        rows[0] = height;
+        rows[1] = height / 2;
+        minBytesPerLine[0] = 2 * width;
+        minBytesPerLine[1] = 4 * (width / 2);
+        break;
+    case QVideoFrameFormat::Format_YUYV:
+    case QVideoFrameFormat::Format_UYVY:
+        planeCount = 1;
+        rows[0] = height;
+        minBytesPerLine[0] = 4 * (width / 2);
+        break;
+    case QVideoFrameFormat::Format_Y8:
+        planeCount = 1;
+        rows[0] = height;
+        minBytesPerLine[0] = width;
+        break;
+    case QVideoFrameFormat::Format_Y16:
+        planeCount = 1;
+        rows[0] = height;
+        minBytesPerLine[0] = 2 * width;
+        break;
+    default:
+        return 0;
     }
+    for (int p = planeCount; p < 3; p++) {
+        rows[p] = 0;
+        minBytesPerLine[p] = 0;
+    }
+    return planeCount;
+}
+
+QDataStream &operator<<(QDataStream& ds, const VideoFrame& f)
+{
+    f.serialize(ds, true);
+    return ds;
+}
+
+QDataStream &operator>>(QDataStream& ds, VideoFrame& f)
+{
+    f.deserialize(ds, true);
     return ds;
 }
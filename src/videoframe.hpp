@@ -44,6 +44,8 @@ public:
     // instances, it is all we need.
     // The copied data is used to represent mapped data after it has been serialized on the
     // main process and deserialized on a child process.
+    // Mapping and the QImage fallback conversion are deferred until prepareData()
+    // is called, so that frames which are never displayed do not cost anything.
     enum Storage {
         Storage_Mapped, // mapped data
         Storage_Copied, // copied data
@@ -71,6 +73,7 @@ public:
     int height;
     float aspectRatio;
     enum Storage storage;
+    bool dataIsPrepared; // are mappedBits or image valid?
     // for mapped and copied data:
     QVideoFrameFormat::PixelFormat pixelFormat;
     bool yuvValueRangeSmall;
@@ -89,7 +92,24 @@ public:
 
     void update(InputMode im, SurroundMode ts, const QVideoFrame& frame, bool newSrc);
     void reUpdate();
+    void prepareData();
     void invalidate();
+
+    // Return a pointer to the data of plane p, for mapped and copied data
+    const uchar* planeData(int p) const;
+
+    // Return the number of planes that are uploaded for frames with mapped or
+    // copied data in the given pixel format, or 0 if the format is not handled.
+    // For each plane, return the number of lines that are read and the minimum
+    // number of bytes per line.
+    static int planeLayout(QVideoFrameFormat::PixelFormat pixelFormat, int width, int height,
+            int rows[3], int minBytesPerLine[3]);
+
+    // Serialize the frame, optionally without the pixel data. Without the
+    // pixel data, the deserialized frame has no valid data pointers, and the
+    // caller must provide them (see FrameRing).
+    void serialize(QDataStream& ds, bool withData) const;
+    void deserialize(QDataStream& ds, bool withData);
 };
 
 QDataStream &operator<<(QDataStream& ds, const VideoFrame& frame);
@@ -24,24 +24,38 @@
 #include "log.hpp"
 
 
-VideoSink::VideoSink(VideoFrame* frame, VideoFrame* extFrame, bool* frameIsNew) :
+VideoSink::VideoSink(FrameQueue* frameQueue) :
     frameCounter(0),
     fileFormatIsMPO(false),
-    frame(frame),
-    extFrame(extFrame),
-    frameIsNew(frameIsNew),
+    frameQueue(frameQueue),
+    droppedFrames(0),
     needExtFrame(false),
     inputMode(Input_Unknown),
     surroundMode(Surround_Unknown)
 {
+    timer.start();
     connect(this, SIGNAL(videoFrameChanged(const QVideoFrame&)), this, SLOT(processNewFrame(const QVideoFrame&)));
 }
 
+// check if the word is part of the file name, separated from neighboring
+// digits or letters by other characters
+static bool fileNameContainsWord(const QString& fileName, const QString& word)
+{
+    int i = fileName.indexOf(word, 0, Qt::CaseInsensitive);
+    return (i >= 0
+            && (i == 0 || !fileName[i - 1].isLetterOrNumber())
+            && (i + word.length() == fileName.length() || !fileName[i + word.length()].isLetterOrNumber()));
+}
+
 // called whenever a new media URL is played:
 void VideoSink::newUrl(const QUrl& url, InputMode im, SurroundMode sm)
 {
     frameCounter = 0;
     fileFormatIsMPO = false;
+    needExtFrame = false;
+    // Frames of the previous media that were not displayed yet must not
+    // show up after the new media started
+    frameQueue->clear();
 
     LOG_DEBUG("initial input mode for %s: %s", qPrintable(url.toString()), inputModeToString(im));
     inputMode = im;
@@ -101,14 +115,16 @@ void VideoSink::newUrl(const QUrl& url, InputMode im, SurroundMode sm)
     if (surroundMode == Surround_Unknown) {
         /* Try to guess the mode from the URL. */
         QString fileName = url.fileName();
-        int i360 = fileName.indexOf("360");
-        if (i360 >= 0 && (i360 == 0 || !fileName[i360 - 1].isLetterOrNumber()) && !fileName[i360 + 3].isLetterOrNumber()) {
+        if (fileNameContainsWord(fileName, "eac"))
+            surroundMode = Surround_360_EAC;
+        else if (fileNameContainsWord(fileName, "cubemap") || fileNameContainsWord(fileName, "c3x2"))
+            surroundMode = Surround_360_Cubemap;
+        else if (fileNameContainsWord(fileName, "fisheye"))
+            surroundMode = Surround_180_Fisheye;
+        else if (fileNameContainsWord(fileName, "360"))
             surroundMode = Surround_360;
-        } else {
-            int i180 = fileName.indexOf("180");
-            if (i180 >= 0 && (i180 == 0 || !fileName[i180 - 1].isLetterOrNumber()) && !fileName[i180 + 3].isLetterOrNumber())
-                surroundMode = Surround_180;
-        }
+        else if (fileNameContainsWord(fileName, "180"))
+            surroundMode = Surround_180;
         if (surroundMode != Surround_Unknown)
             LOG_DEBUG("guessing surround mode %s from file name %s", surroundModeToString(surroundMode), qPrintable(fileName));
     }
@@ -142,15 +158,26 @@ void VideoSink::processNewFrame(const QVideoFrame& frame)
         updateExtFrame = false;
         needExtFrame = false;
     }
+    // Fill the next entry of the frame queue
+    FrameQueue::Entry* entry = frameQueue->producerEntry();
     if (updateExtFrame) {
-        this->extFrame->update(inputMode, surroundMode, frame, frameCounter == 0);
+        entry->extFrame.update(inputMode, surroundMode, frame, frameCounter == 0);
     } else {
-        this->frame->update(inputMode, surroundMode, frame, frameCounter == 0);
-        this->extFrame->invalidate();
+        entry->frame.update(inputMode, surroundMode, frame, frameCounter == 0);
+        entry->extFrame.invalidate();
+        entry->presentationTime = frame.startTime();
+        entry->duration = (frame.startTime() >= 0 && frame.endTime() > frame.startTime()
+                ? frame.endTime() - frame.startTime() : -1);
     }
     if (!needExtFrame) {
         LOG_FIREHOSE("video sink signals that new frame is complete");
-        *frameIsNew = true;
+        entry->arrivalTime = timer.nsecsElapsed();
+        // If the renderer is too far behind and the queue is full,
+        // this drops the oldest frame (in alternating stereo, the oldest pair)
+        if (frameQueue->publish()) {
+            LOG_FIREHOSE("video sink drops frame because the frame queue is full");
+            droppedFrames++;
+        }
         emit newVideoFrame();
     }
     frameCounter++;
@@ -22,9 +22,10 @@
 
 #include <QVideoSink>
 #include <QMediaMetaData>
+#include <QElapsedTimer>
 
 #include "modes.hpp"
-#include "videoframe.hpp"
+#include "framequeue.hpp"
 
 
 class VideoSink : public QVideoSink
@@ -34,14 +35,14 @@ Q_OBJECT
 public:
     unsigned long long frameCounter; // number of frames seen for this URL
     bool fileFormatIsMPO; // flag to work around MPO glitches
-    VideoFrame* frame;    // target video frame
-    VideoFrame* extFrame; // extension to target video frame, for alternating stereo
-    bool *frameIsNew;     // flag to set when the target frame represents a new frame
+    FrameQueue* frameQueue; // target queue for new frames
+    QElapsedTimer timer;    // clock for the arrival time of frames
+    unsigned long long droppedFrames; // number of frames dropped because the queue was full
     bool needExtFrame;    // flag to set in alternating stereo when extFrame is not filled yet
     InputMode inputMode;  // input mode of current media
     SurroundMode surroundMode; // surround mode of the current media
 
-    VideoSink(VideoFrame* frame, VideoFrame* extFrame, bool* frameIsNew);
+    VideoSink(FrameQueue* frameQueue);
 
     void newUrl(const QUrl& url, InputMode inputMode, SurroundMode surroundMode);
 
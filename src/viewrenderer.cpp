@@ -0,0 +1,234 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <QQuaternion>
+#include <QtMath>
+
+#include "viewrenderer.hpp"
+#include "bino.hpp"
+#include "tools.hpp"
+#include "log.hpp"
+
+
+// Vertical field of view of surround views on screen, in degrees
+static const float SurroundFieldOfView = 50.0f;
+// Surround views are rendered with a frustum that is larger by this factor
+static const float SurroundOverscan = 1.25f;
+
+static void surroundFrustum(const ViewRenderer::Parameters& parameters, float* right, float* top)
+{
+    *top = qTan(qDegreesToRadians(SurroundFieldOfView) * 0.5f);
+    *right = *top * float(parameters.width) / parameters.height;
+}
+
+static QMatrix4x4 surroundOrientation(float horizontalAngle, float verticalAngle)
+{
+    QMatrix4x4 orientationMatrix;
+    orientationMatrix.rotate(QQuaternion::fromEulerAngles(verticalAngle, horizontalAngle, 0.0f).inverted());
+    return orientationMatrix;
+}
+
+ViewRenderer::ViewRenderer()
+{
+}
+
+void ViewRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+}
+
+unsigned int ViewRenderer::viewTexture(int buffer, int layers, int width, int height)
+{
+    int slot = buffer;
+    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    if (isGLES)
+        return Bino::instance()->renderTargetPool()->texture(slot, width, height, layers, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV);
+    else
+        return Bino::instance()->renderTargetPool()->texture(slot, width, height, layers, GL_RGB16, GL_RGBA, GL_UNSIGNED_SHORT);
+}
+
+void ViewRenderer::render(const Parameters& parameters, int buffer, Views* views)
+{
+    // Find out about the views we have
+    int viewCount, viewWidth, viewHeight;
+    float frameDisplayAspectRatio;
+    bool surround;
+    Bino::instance()->preRenderProcess(parameters.width, parameters.height, parameters.subtitleTrack,
+            &viewCount, &viewWidth, &viewHeight, &frameDisplayAspectRatio, &surround);
+
+    // Adjust the stereo mode if necessary
+    bool frameIsStereo = (viewCount == 2);
+    OutputMode outputMode = parameters.outputMode;
+    if (!frameIsStereo)
+        outputMode = Output_Left;
+    if (outputMode == Output_Left_Right || outputMode == Output_Right_Left)
+        frameDisplayAspectRatio *= 2.0f;
+    else if (outputMode == Output_Top_Bottom || outputMode == Output_Bottom_Top || outputMode == Output_HDMI_Frame_Pack)
+        frameDisplayAspectRatio *= 0.5f;
+    LOG_FIREHOSE("%s: %d views, %dx%d, %g, surround %s", Q_FUNC_INFO, viewCount, viewWidth, viewHeight, frameDisplayAspectRatio, surround ? "on" : "off");
+    bool surroundViews = (Bino::instance()->assumeSurroundMode() != Surround_Off);
+
+    // Find out how the views will be placed on screen
+    float relWidth = 1.0f;
+    float relHeight = 1.0f;
+    float screenHeight = parameters.height;
+    if (outputMode == Output_HDMI_Frame_Pack)
+        screenHeight = parameters.height - parameters.height / 49.0f;
+    float screenAspectRatio = parameters.width / screenHeight;
+    if (screenAspectRatio < frameDisplayAspectRatio)
+        relHeight = screenAspectRatio / frameDisplayAspectRatio;
+    else
+        relWidth = frameDisplayAspectRatio / screenAspectRatio;
+    float viewDisplayWidth = relWidth * parameters.width;
+    float viewDisplayHeight = relHeight * screenHeight;
+    if (outputMode == Output_Left_Right || outputMode == Output_Left_Right_Half
+            || outputMode == Output_Right_Left || outputMode == Output_Right_Left_Half)
+        viewDisplayWidth *= 0.5f;
+    else if (outputMode == Output_Top_Bottom || outputMode == Output_Top_Bottom_Half
+            || outputMode == Output_Bottom_Top || outputMode == Output_Bottom_Top_Half
+            || outputMode == Output_HDMI_Frame_Pack)
+        viewDisplayHeight *= 0.5f;
+    int viewTexLevels = 1;
+    for (int s = std::max(viewWidth, viewHeight); s > 1; s /= 2)
+        viewTexLevels++;
+    int viewTexMaxLevel = mipmapMaxLevel(std::max(viewWidth / viewDisplayWidth, viewHeight / viewDisplayHeight), viewTexLevels);
+    if (surroundViews) {
+        // keep the resolution on screen for the larger frustum
+        viewWidth = qCeil(viewWidth * SurroundOverscan);
+        viewHeight = qCeil(viewHeight * SurroundOverscan);
+    }
+
+    views->frameIsStereo = frameIsStereo;
+    views->outputMode = outputMode;
+    views->relWidth = relWidth;
+    views->relHeight = relHeight;
+    views->surround = surroundViews;
+    views->surroundHorizontalAngle = parameters.surroundHorizontalAngle;
+    views->surroundVerticalAngle = parameters.surroundVerticalAngle;
+
+    // Find out which views are needed
+    bool needView[2];
+    for (int v = 0; v <= 1; v++) {
+        bool needThisView = true;
+        switch (outputMode) {
+        case Output_Left:
+            needThisView = (v == 0);
+            break;
+        case Output_Right:
+            needThisView = (v == 1);
+            break;
+        case Output_Alternating:
+            needThisView = (v != parameters.alternatingLastView);
+            break;
+        case Output_HDMI_Frame_Pack:
+        case Output_OpenGL_Stereo:
+        case Output_Left_Right:
+        case Output_Left_Right_Half:
+        case Output_Right_Left:
+        case Output_Right_Left_Half:
+        case Output_Top_Bottom:
+        case Output_Top_Bottom_Half:
+        case Output_Bottom_Top:
+        case Output_Bottom_Top_Half:
+        case Output_Even_Odd_Rows:
+        case Output_Even_Odd_Columns:
+        case Output_Checkerboard:
+        case Output_Red_Cyan_Dubois:
+        case Output_Red_Cyan_FullColor:
+        case Output_Red_Cyan_HalfColor:
+        case Output_Red_Cyan_Monochrome:
+        case Output_Green_Magenta_Dubois:
+        case Output_Green_Magenta_FullColor:
+        case Output_Green_Magenta_HalfColor:
+        case Output_Green_Magenta_Monochrome:
+        case Output_Amber_Blue_Dubois:
+        case Output_Amber_Blue_FullColor:
+        case Output_Amber_Blue_HalfColor:
+        case Output_Amber_Blue_Monochrome:
+        case Output_Red_Green_Monochrome:
+        case Output_Red_Blue_Monochrome:
+            break;
+        }
+        needView[v] = needThisView;
+    }
+
+    // Get a view texture of the right size, with one layer per view
+    views->viewTex = viewTexture(buffer, frameIsStereo ? 2 : 1, viewWidth, viewHeight);
+
+    // Render the needed views into their layers
+    QMatrix4x4 projectionMatrix;
+    QMatrix4x4 orientationMatrix;
+    QMatrix4x4 viewMatrix;
+    if (surroundViews) {
+        float right, top;
+        surroundFrustum(parameters, &right, &top);
+        right *= SurroundOverscan;
+        top *= SurroundOverscan;
+        projectionMatrix.frustum(-right, right, -top, top, 1.0f, 100.0f);
+        orientationMatrix = surroundOrientation(parameters.surroundHorizontalAngle, parameters.surroundVerticalAngle);
+    }
+    bool haveViews = false;
+    if (needView[0] && needView[1]) {
+        LOG_FIREHOSE("%s: getting both views in one pass for stereo mode %s", Q_FUNC_INFO, outputModeToString(outputMode));
+        const QMatrix4x4 projectionMatrices[2] = { projectionMatrix, projectionMatrix };
+        const QMatrix4x4 orientationMatrices[2] = { orientationMatrix, orientationMatrix };
+        const QMatrix4x4 viewMatrices[2] = { viewMatrix, viewMatrix };
+        haveViews = Bino::instance()->renderStereo(projectionMatrices, orientationMatrices, viewMatrices,
+                viewWidth, viewHeight, views->viewTex);
+    }
+    for (int v = 0; v <= 1 && !haveViews; v++) {
+        if (!needView[v])
+            continue;
+        LOG_FIREHOSE("%s: getting view %d for stereo mode %s", Q_FUNC_INFO, v, outputModeToString(outputMode));
+        Bino::instance()->render(projectionMatrix, orientationMatrix, viewMatrix, v, viewWidth, viewHeight, views->viewTex, v);
+    }
+
+    // generate only the mipmap levels of the view texture that will be sampled
+    glBindTexture(GL_TEXTURE_2D_ARRAY, views->viewTex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, viewTexMaxLevel);
+    if (viewTexMaxLevel > 0)
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+QMatrix4x4 ViewRenderer::surroundReprojection(const Views& views, const Parameters& parameters)
+{
+    float right, top;
+    surroundFrustum(parameters, &right, &top);
+    // from texture coordinates on screen to a view direction for the new orientation
+    QMatrix4x4 texCoordToDirection(
+            2.0f * right, 0.0f, -right, 0.0f,
+            0.0f, 2.0f * top, -top, 0.0f,
+            0.0f, 0.0f, -1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f);
+    // from the new orientation to the orientation of the rendered views
+    QMatrix4x4 rotation = surroundOrientation(views.surroundHorizontalAngle, views.surroundVerticalAngle)
+        * surroundOrientation(parameters.surroundHorizontalAngle, parameters.surroundVerticalAngle).transposed();
+    // from a view direction to texture coordinates in the larger rendered frustum
+    right *= SurroundOverscan;
+    top *= SurroundOverscan;
+    QMatrix4x4 directionToTexCoord(
+            0.5f / right, 0.0f, -0.5f, 0.0f,
+            0.0f, 0.5f / top, -0.5f, 0.0f,
+            0.0f, 0.0f, -1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f);
+    return directionToTexCoord * rotation * texCoordToDirection;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QMatrix4x4>
+
+#include "modes.hpp"
+
+
+/* Renders the views of the current frame into view textures, which the
+ * widget then puts on screen according to the output mode. This runs either
+ * in the widget's OpenGL context on the GUI thread, or in a shared context
+ * on the render thread (see RenderThread). */
+class ViewRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    /* Everything that the views depend on besides Bino's state */
+    struct Parameters {
+        int width;                     // widget width
+        int height;                    // widget height
+        OutputMode outputMode;
+        int alternatingLastView;       // last view displayed in Output_Alternating, or -1 to render both views
+        float surroundHorizontalAngle; // in degrees
+        float surroundVerticalAngle;   // in degrees
+        qint64 frameSelectionTime;     // media time used to select the frame, see Bino::frameSelectionTime()
+        int subtitleTrack;             // active subtitle track, or -1; see Bino::subtitleTrack()
+    };
+
+    /* The rendered views and what the widget needs to know to display them */
+    struct Views {
+        unsigned int viewTex;          // 2D array texture with one layer per view
+        bool frameIsStereo;
+        OutputMode outputMode;         // the output mode, adjusted to mono frames
+        float relWidth;                // relative size of the views on screen
+        float relHeight;
+        bool surround;                 // are these surround views? if so, they were rendered
+        float surroundHorizontalAngle; // for this orientation, in degrees
+        float surroundVerticalAngle;
+        GLsync renderFence;            // signaled when rendering into the view textures is finished
+        GLsync displayFence;           // signaled when displaying the view textures is finished
+    };
+
+    ViewRenderer();
+
+    void initialize();
+
+    // Render the views into the view texture of the given buffer;
+    // each buffer has its own view texture. Both views are rendered in
+    // a single pass if possible, see Bino::renderStereo().
+    void render(const Parameters& parameters, int buffer, Views* views);
+
+    // Return the homography that maps texture coordinates of surround views
+    // for the orientation in the given parameters to texture coordinates of
+    // the given surround views. The views can thus be reprojected to a new
+    // orientation on display without rendering them again. Surround views are
+    // rendered with a larger field of view than displayed to allow this.
+    static QMatrix4x4 surroundReprojection(const Views& views, const Parameters& parameters);
+
+private:
+    unsigned int viewTexture(int buffer, int layers, int width, int height);
+};
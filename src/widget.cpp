@@ -20,8 +20,6 @@
 
 #include <QGuiApplication>
 #include <QMessageBox>
-#include <QQuaternion>
-#include <QtMath>
 
 #include "widget.hpp"
 #include "playlist.hpp"
@@ -40,7 +38,26 @@
 
 static const QSize SizeBase(16, 9);
 
-Widget::Widget(OutputMode outputMode, QWidget* parent) :
+// Surround views that were rendered longer ago than this (in milliseconds)
+// are rendered again instead of being reprojected, see paintGL()
+static const qint64 MaxReprojectedViewsAge = 50;
+
+// Check whether reprojected surround views cover the whole screen area
+static bool reprojectionCoversView(const QMatrix4x4& reprojection)
+{
+    for (int i = 0; i < 4; i++) {
+        QVector3D p = reprojection.map(QVector3D(i % 2, i / 2, 1.0f));
+        if (p.z() <= 0.0f)
+            return false;
+        float x = p.x() / p.z();
+        float y = p.y() / p.z();
+        if (x < 0.0f || x > 1.0f || y < 0.0f || y > 1.0f)
+            return false;
+    }
+    return true;
+}
+
+Widget::Widget(OutputMode outputMode, bool renderThread, QWidget* parent) :
     QOpenGLWidget(parent),
     _sizeHint(0.5f * SizeBase),
     _outputMode(outputMode),
@@ -50,7 +67,11 @@ Widget::Widget(OutputMode outputMode, QWidget* parent) :
     _surroundHorizontalAngleBase(0.0f),
     _surroundVerticalAngleBase(0.0f),
     _surroundHorizontalAngleCurrent(0.0f),
-    _surroundVerticalAngleCurrent(0.0f)
+    _surroundVerticalAngleCurrent(0.0f),
+    _useRenderThread(renderThread),
+    _renderThread(nullptr),
+    _viewsNeedUpdate(true),
+    _views({ 0, false, Output_Left, 1.0f, 1.0f, false, 0.0f, 0.0f, nullptr, nullptr })
 {
     setUpdateBehavior(QOpenGLWidget::PartialUpdate);
     setMouseTracking(true);
@@ -58,12 +79,20 @@ Widget::Widget(OutputMode outputMode, QWidget* parent) :
     QSize screenSize = QGuiApplication::primaryScreen()->availableSize();
     QSize maxSize = 0.75f * screenSize;
     _sizeHint = SizeBase.scaled(maxSize, Qt::KeepAspectRatio);
-    connect(Bino::instance(), &Bino::newVideoFrame, [=]() { update(); });
+    connect(Bino::instance(), &Bino::newVideoFrame, this, [=]() { updateViews(); });
     connect(Bino::instance(), &Bino::toggleFullscreen, [=]() { emit toggleFullscreen(); });
     connect(Playlist::instance(), SIGNAL(mediaChanged(PlaylistEntry)), this, SLOT(mediaChanged(PlaylistEntry)));
     setFocus();
 }
 
+Widget::~Widget()
+{
+    delete _renderThread;
+    makeCurrent();
+    qDeleteAll(_displayPrgs);
+    doneCurrent();
+}
+
 bool Widget::isOpenGLStereo() const
 {
     return _openGLStereo;
@@ -77,6 +106,7 @@ OutputMode Widget::outputMode() const
 void Widget::setOutputMode(enum OutputMode mode)
 {
     _outputMode = mode;
+    _viewsNeedUpdate = true;
 }
 
 QSize Widget::sizeHint() const
@@ -115,26 +145,6 @@ void Widget::initializeGL()
     LOG_INFO("OpenGL Renderer:     %s", getOpenGLString(this, GL_RENDERER));
     LOG_INFO("OpenGL AnisoTexFilt: %s", haveAnisotropicFiltering ? "yes" : "no");
 
-    // View textures
-    glGenTextures(2, _viewTex);
-    for (int i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, _viewTex[i]);
-        unsigned char nullBytes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
-        if (isGLES)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, 1, 1, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullBytes);
-        else
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, 1, 1, 0, GL_RGBA, GL_UNSIGNED_SHORT, nullBytes);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        if (haveAnisotropicFiltering)
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 4.0f);
-        _viewTexWidth[i] = 1;
-        _viewTexHeight[i] = 1;
-    }
-    CHECK_GL();
-
     // Quad geometry
     const float quadPositions[] = {
         -1.0f, +1.0f, 0.0f,
@@ -171,164 +181,172 @@ void Widget::initializeGL()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
     CHECK_GL();
 
-    // Initialize Bino
-    Bino::instance()->initProcess();
+    // Initialize Bino, either here or in the context of the render thread
+    if (_useRenderThread) {
+        LOG_INFO("Rendering views in a separate thread");
+        _renderThread = new RenderThread(context());
+        connect(_renderThread, &RenderThread::viewsReady, this, [=](bool framesPending) {
+                if (framesPending)
+                    _viewsNeedUpdate = true;
+                update();
+                });
+        _renderThread->start();
+    } else {
+        Bino::instance()->initProcess();
+        _viewRenderer.initialize();
+    }
+    CHECK_GL();
 }
 
-void Widget::rebuildDisplayPrgIfNecessary(OutputMode outputMode)
+Widget::DisplayPrg* Widget::displayPrg(OutputMode outputMode)
 {
     if (outputMode == Output_Right)
         outputMode = Output_Left; // these are handled specially; see shader
-    if (_displayPrg.isLinked() && _displayPrgOutputMode == outputMode)
-        return;
+    DisplayPrg* displayPrg = _displayPrgs.value(int(outputMode), nullptr);
+    if (displayPrg)
+        return displayPrg;
 
-    LOG_DEBUG("rebuilding display program for output mode %s", outputModeToString(outputMode));
+    LOG_DEBUG("building display program for output mode %s", outputModeToString(outputMode));
     bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
     QString vertexShaderSource = readFile(":src/shader-display.vert.glsl");
     QString fragmentShaderSource = readFile(":src/shader-display.frag.glsl");
     fragmentShaderSource.replace("$OUTPUT_MODE", QString::number(int(outputMode)));
     if (isGLES) {
         vertexShaderSource.prepend("#version 320 es\n");
+        // GLSL ES has no default precision for sampler2DArray
         fragmentShaderSource.prepend("#version 320 es\n"
-                "precision mediump float;\n");
+                "precision mediump float;\n"
+                "precision mediump sampler2DArray;\n");
     } else {
         vertexShaderSource.prepend("#version 330\n");
         fragmentShaderSource.prepend("#version 330\n");
     }
-    _displayPrg.removeAllShaders();
-    _displayPrg.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
-    _displayPrg.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
-    _displayPrg.link();
-    _displayPrgOutputMode = outputMode;
+    displayPrg = new DisplayPrg;
+    QOpenGLShaderProgram& prg = displayPrg->prg;
+    prg.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+    prg.addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
+    prg.link();
+    displayPrg->relativeWidthLoc = prg.uniformLocation("relativeWidth");
+    displayPrg->relativeHeightLoc = prg.uniformLocation("relativeHeight");
+    displayPrg->fragOffsetXLoc = prg.uniformLocation("fragOffsetX");
+    displayPrg->fragOffsetYLoc = prg.uniformLocation("fragOffsetY");
+    displayPrg->outputModeLeftRightViewLoc = prg.uniformLocation("outputModeLeftRightView");
+    displayPrg->reprojectionLoc = prg.uniformLocation("reprojection");
+    // The sampler uniforms never change, so set them once
+    prg.bind();
+    prg.setUniformValue("views", 0);
+    _displayPrgs.insert(int(outputMode), displayPrg);
+    return displayPrg;
 }
 
-void Widget::paintGL()
+ViewRenderer::Parameters Widget::viewParameters()
 {
-    bool isGLES = QOpenGLContext::currentContext()->isOpenGLES();
+    // The views become visible on the next display refresh, or with a render
+    // thread on the one after it
+    qreal refreshRate = screen()->refreshRate();
+    qint64 presentationDelay = (refreshRate > 0 ? 1000000 / refreshRate : 0);
+    if (_renderThread)
+        presentationDelay *= 2;
 
-    // Find out about the views we have
-    int viewCount, viewWidth, viewHeight;
-    float frameDisplayAspectRatio;
-    bool surround;
-    Bino::instance()->preRenderProcess(_width, _height, &viewCount, &viewWidth, &viewHeight, &frameDisplayAspectRatio, &surround);
-
-    // Adjust the stereo mode if necessary
-    bool frameIsStereo = (viewCount == 2);
-    OutputMode outputMode = _outputMode;
-    if (!frameIsStereo)
-        outputMode = Output_Left;
-    if (outputMode == Output_Left_Right || outputMode == Output_Right_Left)
-        frameDisplayAspectRatio *= 2.0f;
-    else if (outputMode == Output_Top_Bottom || outputMode == Output_Bottom_Top || outputMode == Output_HDMI_Frame_Pack)
-        frameDisplayAspectRatio *= 0.5f;
-    LOG_FIREHOSE("%s: %d views, %dx%d, %g, surround %s", Q_FUNC_INFO, viewCount, viewWidth, viewHeight, frameDisplayAspectRatio, surround ? "on" : "off");
-
-    // Fill the view texture(s) as needed
-    for (int v = 0; v <= 1; v++) {
-        bool needThisView = true;
-        switch (outputMode) {
-        case Output_Left:
-            needThisView = (v == 0);
-            break;
-        case Output_Right:
-            needThisView = (v == 1);
-            break;
-        case Output_Alternating:
-            needThisView = (v != _alternatingLastView);
-            break;
-        case Output_HDMI_Frame_Pack:
-        case Output_OpenGL_Stereo:
-        case Output_Left_Right:
-        case Output_Left_Right_Half:
-        case Output_Right_Left:
-        case Output_Right_Left_Half:
-        case Output_Top_Bottom:
-        case Output_Top_Bottom_Half:
-        case Output_Bottom_Top:
-        case Output_Bottom_Top_Half:
-        case Output_Even_Odd_Rows:
-        case Output_Even_Odd_Columns:
-        case Output_Checkerboard:
-        case Output_Red_Cyan_Dubois:
-        case Output_Red_Cyan_FullColor:
-        case Output_Red_Cyan_HalfColor:
-        case Output_Red_Cyan_Monochrome:
-        case Output_Green_Magenta_Dubois:
-        case Output_Green_Magenta_FullColor:
-        case Output_Green_Magenta_HalfColor:
-        case Output_Green_Magenta_Monochrome:
-        case Output_Amber_Blue_Dubois:
-        case Output_Amber_Blue_FullColor:
-        case Output_Amber_Blue_HalfColor:
-        case Output_Amber_Blue_Monochrome:
-        case Output_Red_Green_Monochrome:
-        case Output_Red_Blue_Monochrome:
-            break;
+    ViewRenderer::Parameters parameters;
+    parameters.width = _width;
+    parameters.height = _height;
+    parameters.outputMode = _outputMode;
+    // the render thread does not know which view will be displayed when
+    parameters.alternatingLastView = (_renderThread ? -1 : _alternatingLastView);
+    parameters.surroundHorizontalAngle = _surroundHorizontalAngleBase + _surroundHorizontalAngleCurrent;
+    parameters.surroundVerticalAngle = _surroundVerticalAngleBase + _surroundVerticalAngleCurrent;
+    parameters.frameSelectionTime = Bino::instance()->frameSelectionTime(presentationDelay);
+    // Query the media player here, on the GUI thread, and not on the render thread
+    parameters.subtitleTrack = Bino::instance()->subtitleTrack();
+    return parameters;
+}
+
+void Widget::paintGL()
+{
+    ViewRenderer::Parameters parameters = viewParameters();
+    ViewRenderer::Views* views;
+    if (_renderThread) {
+        if (_viewsNeedUpdate) {
+            _renderThread->requestViews(parameters);
+            _viewsNeedUpdate = false;
+        }
+        views = _renderThread->displayViews();
+        if (!views) {
+            // the render thread has not finished any views yet
+            glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            return;
         }
-        if (!needThisView)
-            continue;
-        // prepare view texture
-        glBindTexture(GL_TEXTURE_2D, _viewTex[v]);
-        if (_viewTexWidth[v] != viewWidth || _viewTexHeight[v] != viewHeight) {
-            if (isGLES)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, viewWidth, viewHeight, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, nullptr);
-            else
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, viewWidth, viewHeight, 0, GL_RGBA, GL_UNSIGNED_SHORT, nullptr);
-            _viewTexWidth[v] = viewWidth;
-            _viewTexHeight[v] = viewHeight;
+        if (views->renderFence) {
+            glWaitSync(views->renderFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(views->renderFence);
+            views->renderFence = nullptr;
         }
-        // render view into view texture
-        LOG_FIREHOSE("%s: getting view %d for stereo mode %s", Q_FUNC_INFO, v, outputModeToString(outputMode));
-        QMatrix4x4 projectionMatrix;
-        QMatrix4x4 orientationMatrix;
-        QMatrix4x4 viewMatrix;
-        if (Bino::instance()->assumeSurroundMode() != Surround_Off) {
-            float verticalVieldOfView = qDegreesToRadians(50.0f);
-            float aspectRatio = float(_width) / _height;
-            float top = qTan(verticalVieldOfView * 0.5f);
-            float bottom = -top;
-            float right = top * aspectRatio;
-            float left = -right;
-            projectionMatrix.frustum(left, right, bottom, top, 1.0f, 100.0f);
-            QQuaternion orientation = QQuaternion::fromEulerAngles(
-                    (_surroundVerticalAngleBase + _surroundVerticalAngleCurrent),
-                    (_surroundHorizontalAngleBase + _surroundHorizontalAngleCurrent), 0.0f);
-            orientationMatrix.rotate(orientation.inverted());
+    } else {
+        // If only the surround orientation changed, the last surround views
+        // are reprojected to it instead of being rendered again, as long as
+        // they cover the screen and are not too old
+        bool reprojectOnly = (_views.surround && !_viewsNeedUpdate
+                && _outputMode != Output_Alternating
+                && _viewsAge.isValid() && _viewsAge.elapsed() < MaxReprojectedViewsAge
+                && reprojectionCoversView(ViewRenderer::surroundReprojection(_views, parameters)));
+        if (!reprojectOnly) {
+            _viewsNeedUpdate = false;
+            if (Bino::instance()->selectFrameAt(parameters.frameSelectionTime))
+                updateViews(); // queued frames are not due yet; check again on the next display refresh
+            _viewRenderer.render(parameters, 0, &_views);
+            _viewsAge.start();
         }
-        Bino::instance()->render(projectionMatrix, orientationMatrix, viewMatrix, v, viewWidth, viewHeight, _viewTex[v]);
-        // generate mipmaps for the view texture
-        glBindTexture(GL_TEXTURE_2D, _viewTex[v]);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        views = &_views;
+    }
+
+    // Surround views are always reprojected to the current orientation, so
+    // that orientation changes reach the screen at display refresh rate even
+    // if the views were rendered for an older orientation
+    QMatrix4x4 reprojection;
+    if (views->surround)
+        reprojection = ViewRenderer::surroundReprojection(*views, parameters);
+    displayViews(views, reprojection);
+
+    if (_renderThread) {
+        // Tell the render thread when it may reuse the view textures
+        if (views->displayFence)
+            glDeleteSync(views->displayFence);
+        views->displayFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
     }
 
+    // Update Output_Alternating
+    if (_outputMode == Output_Alternating && views->frameIsStereo) {
+        _alternatingLastView = (_alternatingLastView == 0 ? 1 : 0);
+        update();
+    }
+}
+
+void Widget::displayViews(ViewRenderer::Views* views, const QMatrix4x4& reprojection)
+{
+    OutputMode outputMode = views->outputMode;
+    float relWidth = views->relWidth;
+    float relHeight = views->relHeight;
+
     // Put the views on screen in the current mode
     glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
     glViewport(0, 0, _width, _height);
     glDisable(GL_DEPTH_TEST);
-    float relWidth = 1.0f;
-    float relHeight = 1.0f;
-    float screenAspectRatio = _width / float(_height);
-    if (outputMode == Output_HDMI_Frame_Pack)
-        screenAspectRatio = _width / (_height - _height / 49.0f);
-    if (screenAspectRatio < frameDisplayAspectRatio)
-        relHeight = screenAspectRatio / frameDisplayAspectRatio;
-    else
-        relWidth = frameDisplayAspectRatio / screenAspectRatio;
-    rebuildDisplayPrgIfNecessary((outputMode == Output_OpenGL_Stereo || outputMode == Output_Alternating)
+    DisplayPrg* prg = displayPrg((outputMode == Output_OpenGL_Stereo || outputMode == Output_Alternating)
             ? Output_Left /* also covers Output_Right */ : outputMode);
-    glUseProgram(_displayPrg.programId());
-    _displayPrg.setUniformValue("view0", 0);
-    _displayPrg.setUniformValue("view1", 1);
-    _displayPrg.setUniformValue("relativeWidth", relWidth);
-    _displayPrg.setUniformValue("relativeHeight", relHeight);
+    glUseProgram(prg->prg.programId());
+    prg->prg.setUniformValue(prg->relativeWidthLoc, relWidth);
+    prg->prg.setUniformValue(prg->relativeHeightLoc, relHeight);
+    prg->prg.setUniformValue(prg->reprojectionLoc, reprojection);
     QPoint globalLowerLeft = mapToGlobal(QPoint(0, _height - 1));
-    _displayPrg.setUniformValue("fragOffsetX", float(globalLowerLeft.x()));
-    _displayPrg.setUniformValue("fragOffsetY", float(screen()->geometry().height() - 1 - globalLowerLeft.y()));
+    prg->prg.setUniformValue(prg->fragOffsetXLoc, float(globalLowerLeft.x()));
+    prg->prg.setUniformValue(prg->fragOffsetYLoc, float(screen()->geometry().height() - 1 - globalLowerLeft.y()));
     LOG_FIREHOSE("lower left widget corner in screen coordinates: x=%d y=%d", globalLowerLeft.x(), screen()->geometry().height() - 1 - globalLowerLeft.y());
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _viewTex[0]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, _viewTex[1]);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, views->viewTex);
     glBindVertexArray(_quadVao);
     if (_openGLStereo) {
         LOG_FIREHOSE("widget draw mode: opengl stereo");
@@ -336,15 +354,15 @@ void Widget::paintGL()
         GLenum bufferBackRight = GL_BACK_RIGHT;
         if (outputMode == Output_OpenGL_Stereo) {
             glDrawBuffers(1, &bufferBackLeft);
-            _displayPrg.setUniformValue("outputModeLeftRightView", 0);
+            prg->prg.setUniformValue(prg->outputModeLeftRightViewLoc, 0);
             glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
             glDrawBuffers(1, &bufferBackRight);
-            _displayPrg.setUniformValue("outputModeLeftRightView", 1);
+            prg->prg.setUniformValue(prg->outputModeLeftRightViewLoc, 1);
             glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
         } else {
             if (outputMode == Output_Alternating)
                 outputMode = (_alternatingLastView == 0 ? Output_Right : Output_Left);
-            _displayPrg.setUniformValue("outputModeLeftRightView", outputMode == Output_Left ? 0 : 1);
+            prg->prg.setUniformValue(prg->outputModeLeftRightViewLoc, outputMode == Output_Left ? 0 : 1);
             glDrawBuffers(1, &bufferBackLeft);
             glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
             glDrawBuffers(1, &bufferBackRight);
@@ -354,21 +372,16 @@ void Widget::paintGL()
         LOG_FIREHOSE("widget draw mode: normal");
         if (outputMode == Output_Alternating)
             outputMode = (_alternatingLastView == 0 ? Output_Right : Output_Left);
-        _displayPrg.setUniformValue("outputModeLeftRightView", outputMode == Output_Left ? 0 : 1);
+        prg->prg.setUniformValue(prg->outputModeLeftRightViewLoc, outputMode == Output_Left ? 0 : 1);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
     }
-
-    // Update Output_Alternating
-    if (_outputMode == Output_Alternating && frameIsStereo) {
-        _alternatingLastView = (_alternatingLastView == 0 ? 1 : 0);
-        update();
-    }
 }
 
 void Widget::resizeGL(int w, int h)
 {
     _width = w;
     _height = h;
+    _viewsNeedUpdate = true;
 }
 
 void Widget::keyPressEvent(QKeyEvent* e)
@@ -406,7 +419,12 @@ void Widget::mouseMoveEvent(QMouseEvent* e)
         float dy = posDelta.y();
         float yf = dy / _height; // in [-1,+1]
         _surroundVerticalAngleCurrent = yf * 90.0f;
-        update();
+        // Without a render thread, paintGL() reprojects the current surround
+        // views and decides itself whether they need to be rendered again
+        if (_renderThread)
+            updateViews();
+        else
+            update();
     }
 }
 
@@ -418,3 +436,9 @@ void Widget::mediaChanged(PlaylistEntry)
     _surroundHorizontalAngleCurrent = 0.0f;
     _surroundVerticalAngleCurrent = 0.0f;
 }
+
+void Widget::updateViews()
+{
+    _viewsNeedUpdate = true;
+    update();
+}
@@ -20,11 +20,14 @@
 
 #pragma once
 
+#include <QElapsedTimer>
 #include <QOpenGLWidget>
 #include <QOpenGLExtraFunctions>
 
 #include "modes.hpp"
 #include "bino.hpp"
+#include "viewrenderer.hpp"
+#include "renderthread.hpp"
 
 
 class Widget : public QOpenGLWidget, protected QOpenGLExtraFunctions
@@ -46,16 +49,32 @@ private:
     float _surroundHorizontalAngleCurrent;
     float _surroundVerticalAngleCurrent;
 
-    unsigned int _viewTex[2];
-    int _viewTexWidth[2], _viewTexHeight[2];
+    bool _useRenderThread;
+    RenderThread* _renderThread; // if set, views are rendered in this thread
+    bool _viewsNeedUpdate;       // do the views need to be rendered again by the render thread?
+    ViewRenderer _viewRenderer;  // if there is no render thread
+    ViewRenderer::Views _views;  // if there is no render thread
+    QElapsedTimer _viewsAge;     // time since _views were rendered
     unsigned int _quadVao;
-    QOpenGLShaderProgram _displayPrg;
-    int _displayPrgOutputMode;
-
-    void rebuildDisplayPrgIfNecessary(OutputMode outputMode);
+    /* A linked display program variant with its uniform locations */
+    struct DisplayPrg {
+        QOpenGLShaderProgram prg;
+        int relativeWidthLoc;
+        int relativeHeightLoc;
+        int fragOffsetXLoc;
+        int fragOffsetYLoc;
+        int outputModeLeftRightViewLoc;
+        int reprojectionLoc;
+    };
+    QHash<int, DisplayPrg*> _displayPrgs; // linked variants, see displayPrg()
+
+    DisplayPrg* displayPrg(OutputMode outputMode);
+    ViewRenderer::Parameters viewParameters();
+    void displayViews(ViewRenderer::Views* views, const QMatrix4x4& reprojection);
 
 public:
-    Widget(OutputMode outputMode, QWidget* parent = nullptr);
+    Widget(OutputMode outputMode, bool renderThread, QWidget* parent = nullptr);
+    virtual ~Widget();
 
     bool isOpenGLStereo() const;
     OutputMode outputMode() const;
@@ -73,6 +92,9 @@ public:
 
 public slots:
     void mediaChanged(PlaylistEntry entry);
+    // Like update(), but also make sure that the views are rendered again
+    // (this makes a difference only when a render thread is used)
+    void updateViews();
 
 signals:
     void toggleFullscreen();
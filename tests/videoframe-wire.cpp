@@ -0,0 +1,134 @@
+/*
+ * This file is part of Bino, a 3D video player.
+ *
+ * Copyright (C) 2023
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This test checks that VideoFrame::deserialize() accepts valid frames and
+ * rejects headers whose plane sizes do not fit the pixel format, so that
+ * uploads cannot read past the received plane data. */
+
+#include <cstdio>
+
+#include <QtEndian>
+
+#include "videoframe.hpp"
+
+
+// Offsets of header fields, see the wire format in videoframe.cpp
+static const int planeCountOffset = 44;
+static const int bytesPerLineOffset = 48;
+static const int bytesPerPlaneOffset = 60;
+
+static void initFrame(VideoFrame& f, int width, int height, int lumaPadding)
+{
+    f.inputMode = Input_Mono;
+    f.surroundMode = Surround_Off;
+    f.width = width;
+    f.height = height;
+    f.aspectRatio = float(width) / height;
+    f.storage = VideoFrame::Storage_Copied;
+    f.dataIsPrepared = true;
+    f.pixelFormat = QVideoFrameFormat::Format_YUV420P;
+    f.yuvValueRangeSmall = true;
+    f.yuvSpace = VideoFrame::YUV_BT709;
+    f.planeCount = 3;
+    for (int p = 0; p < 3; p++) {
+        int w = (p == 0 ? width : width / 2);
+        int h = (p == 0 ? height : height / 2);
+        f.bytesPerLine[p] = w + (p == 0 ? lumaPadding : 0);
+        // the last line does not need to be padded
+        f.bytesPerPlane[p] = f.bytesPerLine[p] * (h - 1) + w;
+        f.bits[p].assign(f.bytesPerPlane[p], uchar(p));
+        f.mappedBits[p] = nullptr;
+    }
+}
+
+static QByteArray serialize(const VideoFrame& f)
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    f.serialize(ds, true);
+    return data;
+}
+
+static void patch(QByteArray& data, int offset, qint32 value)
+{
+    qToLittleEndian(value, data.data() + offset);
+}
+
+static bool deserializes(const QByteArray& data)
+{
+    QDataStream ds(data);
+    VideoFrame f;
+    f.deserialize(ds, true);
+    return ds.status() == QDataStream::Ok && f.storage == VideoFrame::Storage_Copied;
+}
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+int main()
+{
+    const int width = 64;
+    const int height = 32;
+    VideoFrame frame;
+
+    initFrame(frame, width, height, 0);
+    QByteArray data = serialize(frame);
+    check(deserializes(data), "valid frame is accepted");
+
+    initFrame(frame, width, height, 64);
+    data = serialize(frame);
+    check(deserializes(data), "valid frame with padded lines is accepted");
+
+    // A luma plane that is one line short
+    QByteArray truncated = data;
+    patch(truncated, bytesPerPlaneOffset, frame.bytesPerLine[0] * (height - 1));
+    check(!deserializes(truncated), "truncated luma plane is rejected");
+
+    // A luma plane that lacks the end of its last line
+    truncated = data;
+    patch(truncated, bytesPerPlaneOffset, frame.bytesPerLine[0] * (height - 1) + width - 1);
+    check(!deserializes(truncated), "luma plane with short last line is rejected");
+
+    // Chroma lines that are shorter than the chroma plane width
+    truncated = data;
+    patch(truncated, bytesPerLineOffset + 4, width / 2 - 1);
+    check(!deserializes(truncated), "short chroma lines are rejected");
+
+    // A plane count that does not match the pixel format
+    truncated = data;
+    patch(truncated, planeCountOffset, 2);
+    check(!deserializes(truncated), "wrong plane count is rejected");
+
+    // A header that promises more data than the stream contains
+    truncated = data;
+    truncated.chop(1);
+    check(!deserializes(truncated), "incomplete payload is rejected");
+
+    if (failures == 0)
+        std::printf("all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}